@@ -26,9 +26,20 @@
 #ifndef TICCL_COMMON_H
 #define TICCL_COMMON_H
 
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <stdexcept>
 #include <map>
 #include <set>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <iterator>
 #include <climits>
+#include <chrono>
+#include <ostream>
+#include <cstdint>
 
 #include "unicode/unistr.h"
 #include "unicode/ustream.h"
@@ -47,12 +58,75 @@ namespace ticcl {
 		const std::map<UChar,bitType>&,
 		bool =false );
 
+  class alphabet_table {
+    // a compiled alphabet: a dense table with the anagram value and the
+    // character class of every UTF-16 code unit. So hash() doesn't need
+    // map lookups nor u_charType() calls
+  public:
+    enum char_kind : uint8_t { CHAR, SPACE, PUNCT, UNK };
+    alphabet_table() {};
+    explicit alphabet_table( const std::map<UChar,bitType>& a ){
+      fill( a );
+    };
+    void fill( const std::map<UChar,bitType>& );
+    const std::map<UChar,bitType>& chars() const { return _chars; };
+    size_t size() const { return _chars.size(); };
+    bool empty() const { return _chars.empty(); };
+    char_kind kind( UChar uc ) const { return char_kind(_info[uc] & KIND_MASK); };
+    bitType value( UChar uc ) const { return _values[uc]; };
+    bool lower_stable( UChar uc ) const { return _info[uc] & STABLE; };
+    // true when lowercasing won't change this code unit
+  private:
+    static constexpr uint8_t KIND_MASK = 3;
+    static constexpr uint8_t STABLE = 4;
+    std::map<UChar,bitType> _chars;
+    std::vector<bitType> _values;
+    std::vector<uint8_t> _info;
+  };
+
+  bitType hash( const icu::UnicodeString& ,
+		const alphabet_table&,
+		bool =false );
+  void hash_batch( const std::vector<icu::UnicodeString>&,
+		   const alphabet_table&,
+		   std::vector<bitType>&,
+		   int =0 );
+  // hash all words, using 'threads' threads. (0 means the OpenMP default)
+
   unsigned int ldCompare( const icu::UnicodeString&,
 			  const icu::UnicodeString& );
+  unsigned int ldCompareDP( const icu::UnicodeString&,
+			    const icu::UnicodeString& );
+  unsigned int ldWithin( const icu::UnicodeString&,
+			 const icu::UnicodeString&,
+			 unsigned int );
+  // ldWithin( s1, s2, k ) returns the distance when it is <= k, and k+1
+  // otherwise. Much cheaper than ldCompare() when most pairs are rejected
+
+  enum class ld_kernel { AUTO, SCALAR, SSE4, AVX2 };
+  ld_kernel ld_best_kernel();
+  std::string toString( ld_kernel );
+  void ldCompareMany( const icu::UnicodeString&,
+		      const icu::UnicodeString *,
+		      size_t,
+		      unsigned int *,
+		      ld_kernel = ld_kernel::AUTO );
+  // the Levenshtein distances between 1 query and n candidates.
+  // AUTO selects the best kernel that the CPU supports
+  inline void ldCompareMany( const icu::UnicodeString& query,
+			     const std::vector<icu::UnicodeString>& cands,
+			     std::vector<unsigned int>& result,
+			     ld_kernel kernel = ld_kernel::AUTO ){
+    result.resize( cands.size() );
+    ldCompareMany( query, cands.data(), cands.size(), result.data(), kernel );
+  }
 
   bool fillAlphabet( std::istream&,
 		     std::map<UChar,bitType>&,
 		     int =0 );
+  bool fillAlphabet( std::istream&,
+		     alphabet_table&,
+		     int =0 );
 
   inline bool ispunct( int8_t charT ){
     return ( charT == U_OTHER_PUNCTUATION ||
@@ -122,6 +196,34 @@ namespace ticcl {
     return isletter( charT );
   }
 
+  // a light weight tokenizer for the '~', '#' and ',' separated formats.
+  // It works on the raw UTF-8 lines, so only the word fields need to be
+  // converted to UnicodeString
+  size_t split_view( std::string_view,
+		     char,
+		     std::vector<std::string_view>& );
+  // like TiCC::split_at(): fields are trimmed and empty fields are skipped.
+  // the views point into the line, so keep it alive
+  std::string_view trim_view( std::string_view );
+  size_t utf16_length( std::string_view );
+  // the length the UTF-8 string would have as a UnicodeString
+  inline icu::UnicodeString view_to_unicode( std::string_view sv ){
+    return icu::UnicodeString::fromUTF8( icu::StringPiece( sv.data(),
+							   sv.size() ) );
+  }
+  template <typename T>
+  T view_to( std::string_view sv ){
+    // like TiCC::stringTo<T>(), for integer types, using std::from_chars
+    sv = trim_view( sv );
+    T result = 0;
+    auto res = std::from_chars( sv.data(), sv.data() + sv.size(), result );
+    if ( res.ec != std::errc() ){
+      throw std::runtime_error( "conversion from string '" + std::string(sv)
+				+ "' to an integer failed" );
+    }
+    return result;
+  }
+
   std::set<bitType> read_bit_set( std::istream& );
   std::set<bitType> read_anahash( std::istream&,
 				  const int&,
@@ -130,6 +232,593 @@ namespace ticcl {
 				  bool );
   std::set<bitType> read_confusions( std::istream& );
 
+  class bit_hash_set {
+    // a flat open-addressing hash set for bitType values.
+    // much faster to probe than a std::set<bitType> and only 8 to 16 bytes
+    // per value
+  public:
+    bit_hash_set(): _size(0), _mask(0), _shift(64), _has_empty(false) {};
+    template <typename It>
+    bit_hash_set( It b, It e ): bit_hash_set() {
+      reserve( std::distance( b, e ) );
+      for ( ; b != e; ++b ){
+	insert( *b );
+      }
+    }
+    void reserve( size_t );
+    bool insert( bitType );
+    bool contains( bitType val ) const {
+      if ( val == EMPTY ){
+	return _has_empty;
+      }
+      if ( _table.empty() ){
+	return false;
+      }
+      size_t pos = slot( val );
+      while ( _table[pos] != EMPTY ){
+	if ( _table[pos] == val ){
+	  return true;
+	}
+	pos = (pos+1) & _mask;
+      }
+      return false;
+    }
+    size_t size() const { return _size; };
+    bool empty() const { return _size == 0; };
+  private:
+    static constexpr bitType EMPTY = ULLONG_MAX;
+    size_t slot( bitType val ) const {
+      // Fibonacci hashing, the high bits are the best mixed ones
+      return ( val * 0x9E3779B97F4A7C15ULL ) >> _shift & _mask;
+    }
+    void rehash( size_t );
+    std::vector<bitType> _table;
+    size_t _size;
+    size_t _mask;
+    int _shift;
+    bool _has_empty;
+  };
+
+  class bit_array;
+
+  using diff_pair = std::pair<bitType,bitType>; // ( confusion, anagram value )
+
+  std::vector<diff_pair> merge_pairs( std::vector<std::vector<diff_pair>>& );
+  // sort, unique and merge a number of pair vectors (one per thread), in
+  // parallel. The vectors are emptied
+  std::vector<diff_pair> read_index( std::istream& );
+  // read an .index or .indexNT file as pairs, sorted and unique.
+  // throws a runtime_error on problems
+  void write_index( std::ostream&,
+		    const std::vector<diff_pair>&,
+		    std::ostream * = 0 );
+  // write sorted, unique pairs in the index format, and optionally the
+  // number of values per confusion, as in the --confstats files
+
+  class confusion_filter {
+    // a set of confusion values, to scan a window of sorted anagram values
+    // for differences that are confusions. A compact bitmap, with about 32
+    // bits per confusion, rejects most differences at once, the rest is
+    // checked in a bit_hash_set. The AVX2 kernel handles 4 values at a time
+  public:
+    confusion_filter( const bitType *, const bitType * );
+    bool contains( bitType val ) const {
+      return maybe( val ) && _table.contains( val );
+    }
+    bitType max() const { return _max; };
+    size_t size() const { return _table.size(); };
+    void scan( bitType,
+	       const bitType *,
+	       size_t,
+	       bool,
+	       std::vector<size_t>&,
+	       ld_kernel = ld_kernel::AUTO ) const;
+    // scan( focus, vals, n, below, hits ) adds to hits the indices i for
+    // which the distance between focus and vals[i] is a confusion value.
+    // all vals[i] must be below focus when 'below' is true, and above it
+    // otherwise. Only the SCALAR and AVX2 kernels exist, SSE4 means SCALAR
+    size_t find_pairs( bitType,
+		       const bit_array&,
+		       std::vector<diff_pair>& ) const;
+    // find_pairs( focus, anagrams, pairs ) adds a ( confusion, lowest value )
+    // pair for every anagram value that differs a confusion from focus.
+    // returns the number of anagram values that were scanned
+  private:
+    size_t bit_pos( bitType val ) const {
+      // the low 32 bits of the folded value times a 32 bit golden ratio.
+      // cheap to do in SIMD lanes too
+      uint64_t folded = ( val ^ ( val >> 32 ) ) & 0xFFFFFFFFULL;
+      return ( folded * 0x9E3779B1ULL ) >> _shift;
+    }
+    bool maybe( bitType val ) const {
+      size_t pos = bit_pos( val );
+      return ( _bitmap[pos >> 6] >> ( pos & 63 ) ) & 1;
+    }
+    void scan_scalar( bitType, const bitType *, size_t, size_t,
+		      bool, std::vector<size_t>& ) const;
+    void scan_avx2( bitType, const bitType *, size_t,
+		    bool, std::vector<size_t>& ) const;
+    bit_hash_set _table;
+    std::vector<uint64_t> _bitmap;
+    int _shift;
+    bitType _max;
+  };
+
+  using word_id = uint32_t;
+  const word_id NO_WORD = UINT32_MAX;
+
+  class word_table {
+    // interns words, and hands out 32-bit ids for them.
+    // every word is stored only once, in one big character pool, together
+    // with its frequency and the id of its lowercase form. Lowercase forms
+    // are entries too (shared with the word itself when that is lowercase
+    // already) and hold the 'low' frequency.
+    // word() and lower() return read-only aliases into the pool. These are
+    // invalidated by add(). Lookups are safe to do from several threads,
+    // adding isn't.
+  public:
+    word_table(): _words(0), _mask(0) {};
+    void reserve( size_t );
+    word_id add( const icu::UnicodeString&, size_t );
+    word_id add_part( const icu::UnicodeString& );
+    // intern a string that isn't a word itself (yet), like a part of an
+    // n-gram, with its lowercase form. It has a frequency of 0
+    void split_words( const icu::UnicodeString& );
+    // split all words at the separator, once, and intern the parts
+    size_t part_count( word_id id ) const {
+      // 0 for entries that weren't split
+      return ( id + 1 < _part_index.size() ?
+	       _part_index[id+1] - _part_index[id] : 0 );
+    };
+    word_id part( word_id id, size_t i ) const {
+      return _parts[_part_index[id]+i];
+    };
+    word_id find( const icu::UnicodeString& ) const;
+    // NO_WORD when it isn't an added word
+    word_id find_lower( const icu::UnicodeString& ) const;
+    // NO_WORD when it isn't the lowercase form of an added word
+    icu::UnicodeString word( word_id id ) const {
+      const entry& e = _entries[id];
+      return icu::UnicodeString( false, &_pool[e.offset], e.length );
+    };
+    icu::UnicodeString lower( word_id id ) const {
+      return word( _entries[id].lower );
+    };
+    word_id lower_id( word_id id ) const { return _entries[id].lower; };
+    size_t freq( word_id id ) const { return _entries[id].freq; };
+    size_t low_freq( word_id id ) const {
+      return _entries[_entries[id].lower].low_freq;
+    };
+    void set_low_freq( word_id id, size_t f ){
+      _entries[_entries[id].lower].low_freq = f;
+    };
+    bool is_word( word_id id ) const { return _entries[id].is_word; };
+    size_t size() const { return _words; };
+    bool empty() const { return _words == 0; };
+  private:
+    struct entry {
+      size_t offset;
+      int32_t length;
+      word_id lower;
+      size_t freq;
+      size_t low_freq;
+      uint32_t hash;
+      bool is_word;
+    };
+    word_id lookup( const UChar *, int32_t, uint32_t ) const;
+    word_id intern( const icu::UnicodeString& );
+    void rehash( size_t );
+    std::vector<UChar> _pool;
+    std::vector<entry> _entries;
+    std::vector<word_id> _slots;
+    std::vector<uint32_t> _part_index;
+    std::vector<word_id> _parts;
+    size_t _words;
+    size_t _mask;
+  };
+
+  uint32_t hash_uchars( const UChar *, int32_t );
+  // FNV-1a hash of a UTF-16 string
+
+  class string_arena {
+    // a bump allocator for UTF-16 strings. Strings are copied into big
+    // blocks that are never moved nor freed until the arena is destroyed,
+    // so the returned pointers stay valid. The blocks grow with the amount
+    // stored, up to max_block UChars
+  public:
+    explicit string_arena( size_t max_block = 1<<20 ):
+      _max_block(max_block), _block_size(0), _pos(0), _used(0) {};
+    string_arena( const string_arena& ) = delete;
+    string_arena& operator=( const string_arena& ) = delete;
+    string_arena( string_arena&& ) = default;
+    string_arena& operator=( string_arena&& ) = default;
+    const UChar *store( const UChar *, int32_t );
+    size_t used() const { return _used; };
+    // the number of UChars stored
+  private:
+    std::vector<std::unique_ptr<UChar[]>> _blocks;
+    std::vector<std::unique_ptr<UChar[]>> _large;
+    size_t _max_block;
+    size_t _block_size;
+    size_t _pos;
+    size_t _used;
+  };
+
+  template <typename T>
+  class word_map {
+    // a flat open-addressing hash map from words to T, meant for
+    // lexicon-sized word counts. The words are stored in a string_arena,
+    // so there is no heap allocation per entry.
+    // Iteration is in insertion order, use sorted() for the std::map order.
+    // Adding words invalidates references to the values.
+  public:
+    struct entry {
+      const UChar *text;
+      int32_t length;
+      uint32_t hash;
+      T value;
+      icu::UnicodeString word() const {
+	// a read-only alias, valid as long as the map lives
+	return icu::UnicodeString( false, text, length );
+      };
+      bool operator<( const entry& other ) const {
+	// the same order as UnicodeString::operator<
+	return std::lexicographical_compare( text, text+length,
+					     other.text,
+					     other.text+other.length );
+      };
+    };
+    using iterator = typename std::vector<entry>::iterator;
+    using const_iterator = typename std::vector<entry>::const_iterator;
+    word_map(): _mask(0) {};
+    void reserve( size_t n ){
+      // keep the load factor below 0.5
+      _entries.reserve( n );
+      size_t buckets = 16;
+      while ( buckets < 2*n ){
+	buckets <<= 1;
+      }
+      if ( buckets > _slots.size() ){
+	rehash( buckets );
+      }
+    };
+    T& operator[]( const icu::UnicodeString& word ){
+      const UChar *s = word.getBuffer();
+      int32_t len = word.length();
+      uint32_t h = hash_uchars( s, len );
+      size_t pos = lookup( s, len, h );
+      if ( pos != NO_SLOT ){
+	return _entries[_slots[pos]].value;
+      }
+      if ( 2*(_entries.size()+1) > _slots.size() ){
+	reserve( std::max<size_t>( 8, 2*_entries.size() ) );
+      }
+      pos = h & _mask;
+      while ( _slots[pos] != EMPTY ){
+	pos = (pos+1) & _mask;
+      }
+      _slots[pos] = _entries.size();
+      _entries.push_back( entry{ _arena.store( s, len ), len, h, T() } );
+      return _entries.back().value;
+    };
+    T *find( const icu::UnicodeString& word ){
+      size_t pos = lookup( word );
+      return pos == NO_SLOT ? 0 : &_entries[_slots[pos]].value;
+    };
+    const T *find( const icu::UnicodeString& word ) const {
+      size_t pos = lookup( word );
+      return pos == NO_SLOT ? 0 : &_entries[_slots[pos]].value;
+    };
+    bool contains( const icu::UnicodeString& word ) const {
+      return lookup( word ) != NO_SLOT;
+    };
+    size_t size() const { return _entries.size(); };
+    bool empty() const { return _entries.empty(); };
+    iterator begin() { return _entries.begin(); };
+    iterator end() { return _entries.end(); };
+    const_iterator begin() const { return _entries.begin(); };
+    const_iterator end() const { return _entries.end(); };
+    std::vector<const entry*> sorted() const {
+      std::vector<const entry*> result;
+      result.reserve( _entries.size() );
+      for ( const auto& e : _entries ){
+	result.push_back( &e );
+      }
+      std::sort( result.begin(), result.end(),
+		 []( const entry *e1, const entry *e2 ){ return *e1 < *e2; } );
+      return result;
+    };
+  private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+    static constexpr size_t NO_SLOT = SIZE_MAX;
+    size_t lookup( const icu::UnicodeString& word ) const {
+      const UChar *s = word.getBuffer();
+      int32_t len = word.length();
+      return lookup( s, len, hash_uchars( s, len ) );
+    };
+    size_t lookup( const UChar *s, int32_t len, uint32_t h ) const {
+      if ( _slots.empty() ){
+	return NO_SLOT;
+      }
+      size_t pos = h & _mask;
+      while ( _slots[pos] != EMPTY ){
+	const entry& e = _entries[_slots[pos]];
+	if ( e.hash == h
+	     && e.length == len
+	     && std::equal( s, s+len, e.text ) ){
+	  return pos;
+	}
+	pos = (pos+1) & _mask;
+      }
+      return NO_SLOT;
+    };
+    void rehash( size_t buckets ){
+      // buckets MUST be a power of 2
+      _slots.assign( buckets, EMPTY );
+      _mask = buckets - 1;
+      for ( size_t i=0; i < _entries.size(); ++i ){
+	size_t pos = _entries[i].hash & _mask;
+	while ( _slots[pos] != EMPTY ){
+	  pos = (pos+1) & _mask;
+	}
+	_slots[pos] = i;
+      }
+    };
+    string_arena _arena;
+    std::vector<entry> _entries;
+    std::vector<uint32_t> _slots;
+    size_t _mask;
+  };
+
+  class thread_load {
+    // bookkeeping of the busy time per thread in a parallel loop, to be
+    // able to check the load balance afterwards
+  public:
+    explicit thread_load( int );
+    void add( double, size_t = 1 );
+    // add busy seconds and handled items for the calling thread
+    void report( std::ostream& ) const;
+    // busy and idle time per thread, since construction
+    static double now(){
+      return std::chrono::duration<double>( std::chrono::steady_clock::now()
+					    .time_since_epoch() ).count();
+    };
+  private:
+    struct alignas(64) slot {
+      // one cache line per thread, to avoid false sharing
+      double busy;
+      size_t items;
+    };
+    std::vector<slot> _slots;
+    double _start;
+  };
+
+  enum class bit_kind : uint32_t { PLAIN=0, ANAHASH=1, FOCI=2, CONFUSIONS=3 };
+  std::string toString( bit_kind );
+
+  struct bit_file_header {
+    // a binary bit file is this header, followed by 'count' sorted, unique
+    // bitType values in native byte order
+    char magic[8];
+    bit_kind kind;
+    int32_t low;      // the --low and --high word length filter of an
+    int32_t high;     // ANAHASH file. 0 otherwise
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t skipped; // number of values skipped by that filter
+  };
+
+  class bit_array {
+    // a sorted array of unique bitType values, with a std::set like
+    // interface. The values are either kept in a vector or memory
+    // mapped from a binary bit file. (see write_bit_file())
+  public:
+    bit_array();
+    explicit bit_array( std::vector<bitType>&& );
+    bit_array( bit_array&& ) noexcept;
+    bit_array& operator=( bit_array&& ) noexcept;
+    bit_array( const bit_array& ) = delete;
+    bit_array& operator=( const bit_array& ) = delete;
+    ~bit_array();
+    static bit_array map_file( const std::string& );
+    using const_iterator = const bitType *;
+    using const_reverse_iterator = std::reverse_iterator<const bitType *>;
+    const_iterator begin() const { return _data; };
+    const_iterator end() const { return _data + _size; };
+    const_reverse_iterator rbegin() const { return const_reverse_iterator( end() ); };
+    const_reverse_iterator rend() const { return const_reverse_iterator( begin() ); };
+    const_iterator find( bitType ) const;
+    bitType back() const { return _data[_size-1]; };
+    size_t size() const { return _size; };
+    bool empty() const { return _size == 0; };
+    bool is_mapped() const { return _map != 0; };
+    const bit_file_header& header() const { return _header; };
+  private:
+    void release();
+    std::vector<bitType> _vec;
+    const bitType *_data;
+    size_t _size;
+    void *_map;
+    size_t _map_size;
+    bit_file_header _header;
+  };
+
+  bool is_bit_file( const std::string& );
+  void write_bit_file( const std::string&,
+		       const bit_array&,
+		       bit_kind,
+		       int = 0,
+		       int = 0,
+		       size_t = 0 );
+  bit_array load_bit_set( const std::string& );
+  bit_array load_anahash( const std::string&,
+			  int,
+			  int,
+			  size_t&,
+			  bool );
+  bit_array load_confusions( const std::string& );
+  // the load functions accept text files and binary bit files. Binary files
+  // are memory mapped and checked for the right kind and filter.
+  // load_anahash() also takes an anagram word index (see anagram_index).
+  // they throw a runtime_error on problems
+
+  bool parse_shard( const std::string&, size_t&, size_t& );
+  // parse a --shard value 'i/N', with 1 <= i <= N
+  bit_array shard_of( const bit_array&, size_t, size_t );
+  // shard_of( values, i, N ) returns the i-th of N consecutive, equally
+  // sized slices of values
+
+  struct index_file_header {
+    // a binary index file is this header, followed by a record per
+    // confusion value: the confusion value, the number of anagram values and
+    // the size in bytes of the encoded anagram values, as varints, followed
+    // by the anagram values, sorted and encoded as varint deltas.
+    // The records are in increasing confusion order. After them, aligned
+    // on 8 bytes, is a table with the offset of every record, starting at
+    // 'table'. 'table' is 0 as long as the file isn't finished.
+    char magic[8];
+    uint64_t confusions;
+    uint64_t values;
+    uint64_t table;
+  };
+
+  class index_writer {
+    // writes a binary index file. The confusion values must be added in
+    // increasing order, each with its sorted, unique anagram values.
+    // throws a runtime_error on problems
+  public:
+    explicit index_writer( const std::string&, size_t = 0 );
+    // with a size > 0, an unfinished index file is cut back to that size
+    // (a size returned by flush() earlier) and extended
+    ~index_writer();
+    index_writer( const index_writer& ) = delete;
+    index_writer& operator=( const index_writer& ) = delete;
+    void add( bitType, const std::vector<bitType>& );
+    void add_encoded( bitType, size_t, const char *, size_t );
+    // add values encoded by encode()
+    static void encode( const std::vector<bitType>&, std::string& );
+    // append the encoded values to the string
+    size_t flush();
+    // write everything added to disk, returns the size of the file
+    void close();
+    // write the table and the header, the file is finished then
+  private:
+    std::unique_ptr<std::fstream> _os;
+    std::string _name;
+    std::vector<uint64_t> _table;
+    bitType _last;
+    uint64_t _values;
+    uint64_t _pos;
+  };
+
+  class index_reader {
+    // a memory mapped binary index file
+  public:
+    explicit index_reader( const std::string& );
+    ~index_reader();
+    index_reader( const index_reader& ) = delete;
+    index_reader& operator=( const index_reader& ) = delete;
+    size_t size() const { return _header.confusions; };
+    size_t value_count() const { return _header.values; };
+    bitType confusion( size_t ) const;
+    bitType values( size_t, std::vector<bitType>& ) const;
+    // decode the anagram values of the i-th confusion value, returns that
+    // confusion value
+  private:
+    const unsigned char *record( size_t,
+				 bitType&,
+				 uint64_t&,
+				 uint64_t& ) const;
+    const unsigned char *_data;
+    const uint64_t *_table;
+    void *_map;
+    size_t _map_size;
+    index_file_header _header;
+  };
+
+  bool is_index_file( const std::string& );
+  // true for binary index files
+  std::vector<diff_pair> load_index( const std::string& );
+  // read a text or binary index file as pairs, sorted and unique.
+  // throws a runtime_error on problems
+  void write_index( index_writer&,
+		    const std::vector<diff_pair>&,
+		    std::ostream * = 0 );
+  // write sorted, unique pairs in a binary index file, and optionally the
+  // --confstats file
+
+  struct anagram_file_header {
+    // a binary anagram word index holds the words of every anagram value,
+    // like an .anahash file. This header is followed by the words, in UTF-8
+    // and without separators, per anagram value. Then, aligned on 8 bytes
+    // and starting at 'table', come 3 uint64_t arrays:
+    //  - the anagram values, sorted
+    //  - for every value the index of its first word, plus one extra entry
+    //  - for every word its offset from the start of the file, plus one
+    // 'table' is 0 as long as the file isn't finished.
+    char magic[8];
+    uint64_t keys;
+    uint64_t words;
+    uint64_t table;
+  };
+
+  class anagram_writer {
+    // writes a binary anagram word index. The anagram values must be added
+    // in increasing order, each followed by its words.
+    // throws a runtime_error on problems
+  public:
+    explicit anagram_writer( const std::string& );
+    ~anagram_writer();
+    anagram_writer( const anagram_writer& ) = delete;
+    anagram_writer& operator=( const anagram_writer& ) = delete;
+    void add_key( bitType );
+    void add_word( std::string_view );
+    // a word in UTF-8, for the last added anagram value
+    void close();
+    // write the tables and the header, the file is finished then
+  private:
+    std::unique_ptr<std::ofstream> _os;
+    std::string _name;
+    std::vector<uint64_t> _keys;
+    std::vector<uint64_t> _first;
+    std::vector<uint64_t> _offsets;
+    uint64_t _pos;
+  };
+
+  class anagram_index {
+    // a memory mapped binary anagram word index
+  public:
+    explicit anagram_index( const std::string& );
+    ~anagram_index();
+    anagram_index( const anagram_index& ) = delete;
+    anagram_index& operator=( const anagram_index& ) = delete;
+    size_t size() const { return _header.keys; };
+    size_t word_count() const { return _header.words; };
+    bitType key( size_t i ) const { return _keys[i]; };
+    size_t find( bitType ) const;
+    // the position of the anagram value, or size() when it isn't there
+    size_t first_word( size_t i ) const { return _first[i]; };
+    // the words of the i-th value are first_word(i) upto first_word(i+1)
+    std::string_view word( size_t w ) const {
+      return std::string_view( _data + _offsets[w],
+			       _offsets[w+1] - _offsets[w] );
+    };
+  private:
+    const char *_data;
+    const uint64_t *_keys;
+    const uint64_t *_first;
+    const uint64_t *_offsets;
+    void *_map;
+    size_t _map_size;
+    anagram_file_header _header;
+  };
+
+  bool is_anagram_index( const std::string& );
+  // true for binary anagram word index files
+  size_t write_anagram_index( const std::string&, const std::string& );
+  // convert an .anahash file into a binary anagram word index. Returns the
+  // number of anagram values. throws a runtime_error on problems
+
 } // namespace ticcl
 
 inline std::string toString( int8_t c ){
@@ -29,13 +29,19 @@
 #include <cassert>
 #include <set>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
 #include <limits>
 #include <vector>
+#include <algorithm>
+#include <memory>
 #include <cstdlib>
 #include <string>
 #include <stdexcept>
 #include <iostream>
 #include <fstream>
+#include <filesystem>
 #include "config.h"
 #ifdef HAVE_OPENMP
 #include "omp.h"
@@ -58,6 +64,7 @@ void usage( const string& progname ){
   cerr << "usage: " << progname << endl;
   cerr << "\t--index <confuslist>\t inputfile produced by TICCL-indexer or TICCL-indexerNT." << endl;
   cerr << "\t--hash <anahash>\t a file produced by TICCl-anahash," << endl;
+  cerr << "\t\t or its binary anagram word index. (TICCL-anahash --binary)" << endl;
   cerr << "\t--clean <cleanfile>\t a file produced by TICCL-unk" << endl;
   cerr << "\t--diac <diacriticsfile>\t a list of 'diacritical' confusions." << endl;
   cerr << "\t--hist <historicalfile>\t a list of 'historical' confusions." << endl;
@@ -75,6 +82,9 @@ void usage( const string& progname ){
   cerr << "\t--high=<high>\t skip entries from the anagram file longer than "
        << endl;
   cerr << "\t\t\t'high' characters. (default=35)" << endl;
+  cerr << "\t--checkpoint=<secs>\t save the progress every 'secs' seconds in" << endl;
+  cerr << "\t\t\t <outputfile>.checkpoint. (default 600, 0 means never)" << endl;
+  cerr << "\t--resume\t continue an interrupted run from its checkpoint." << endl;
   cerr << "\t-v\t\t be verbose, repeat to be more verbose " << endl;
   cerr << "\t-h or --help\t this message " << endl;
   cerr << "\t-V or --version\t show version " << endl;
@@ -84,131 +94,196 @@ void usage( const string& progname ){
 set<UnicodeString> follow_words;
 map<UChar,bitType> alphabet;
 
+template <typename Table>
+class sharded_table {
+  // an unordered_map or unordered_set with 64-bit keys, split in shards
+  // that each have their own lock. So many threads can insert at once,
+  // instead of waiting for one critical section.
+  // Only emplace() is thread safe, the rest is for when all threads are done
+public:
+  using key_type = typename Table::key_type;
+  using value_type = typename Table::value_type;
+  // a set only hands out const values
+  using pointer = decltype( &*std::declval<Table&>().begin() );
+  sharded_table(): _shards( SHARDS ) {}
+  template <typename... Args>
+  pair<pointer,bool> emplace( key_type key, Args&&... args ){
+    // like Table::emplace(): when the key is present already, the stored
+    // value stays. Returns the stored value, and true when it is new
+    shard& s = _shards[shard_of( key )];
+    lock_guard<mutex> guard( s.lock );
+    auto res = s.table.emplace( key, std::forward<Args>(args)... );
+    return { &*res.first, res.second };
+  }
+  pointer find( key_type key ){
+    Table& table = _shards[shard_of( key )].table;
+    auto it = table.find( key );
+    return it == table.end() ? 0 : &*it;
+  }
+  size_t size() const {
+    size_t result = 0;
+    for ( const auto& s : _shards ){
+      result += s.table.size();
+    }
+    return result;
+  }
+  void reserve( size_t size ){
+    for ( auto& s : _shards ){
+      s.table.reserve( size / SHARDS + 1 );
+    }
+  }
+  void clear(){
+    for ( auto& s : _shards ){
+      s.table.clear();
+    }
+  }
+  template <typename F>
+  void for_each( F f ) const {
+    for ( const auto& s : _shards ){
+      for ( const auto& val : s.table ){
+	f( val );
+      }
+    }
+  }
+private:
+  static const size_t SHARD_BITS = 8;
+  static const size_t SHARDS = size_t(1) << SHARD_BITS;
+  static size_t shard_of( uint64_t key ){
+    // the high bits of a multiplicative hash, the low bits of the keys
+    // are not spread well (a word id pair, an anagram value)
+    return ( key * 0x9E3779B97F4A7C15ULL ) >> ( 64 - SHARD_BITS );
+  }
+  struct alignas(64) shard {
+    // one per cache line, so the locks don't share lines
+    mutex lock;
+    Table table;
+  };
+  vector<shard> _shards;
+};
+
 class ld_record {
+  // a candidate pair: two word ids and what we found out about them.
+  // The strings, lowercase forms, frequencies and n-gram parts are
+  // properties of the words, looked up in the word_table when needed
 public:
-  ld_record( const UnicodeString&,
-	     const UnicodeString&,
+  ld_record( ticcl::word_id,
+	     ticcl::word_id,
 	     bitType key1,
 	     bitType key2,
-	     const map<UnicodeString,size_t>&,
-	     const map<UnicodeString,size_t>&,
 	     bool, bool, bool,
 	     bool );
   void flip(){
-    str1.swap(str2);
-    ls1.swap(ls2);
-    swap( freq1, freq2 );
-    swap( low_freq1, low_freq2 );
+    swap( id1, id2 );
   }
-  bool analyze_ngrams( const map<UnicodeString, size_t>&,
+  bool analyze_ngrams( const ticcl::word_table&,
 		       size_t, size_t,
 		       map<UnicodeString,set<UnicodeString>>&,
 		       map<UnicodeString, size_t>&,
 		       map<UnicodeString, size_t>& );
-  bool handle_the_pair( const UnicodeString&,
-			const UnicodeString&,
-			const map<UnicodeString, size_t>&,
+  bool handle_the_pair( ticcl::word_id,
+			ticcl::word_id,
+			const ticcl::word_table&,
 			size_t,
 			size_t,
 			map<UnicodeString,set<UnicodeString>>&,
 			map<UnicodeString, size_t>&,
 			map<UnicodeString, size_t>& );
-  bool ld_is( int );
-  bool ld_check( int );
-  void fill_fields( size_t );
-  void sort_high_second();
-  bool test_frequency( size_t );
-  bool acceptable( size_t, const map<UChar,bitType>& );
-  UnicodeString get_key() const;
-  string toString() const;
-  UnicodeString str1;
-  UnicodeString ls1;
-  size_t freq1;
-  size_t low_freq1;
-  UnicodeString str2;
-  UnicodeString ls2;
-  size_t freq2;
-  size_t low_freq2;
+  int ld_upto( const ticcl::word_table&, int ) const;
+  bool ld_is( const ticcl::word_table&, int );
+  bool ld_check( const ticcl::word_table&, int );
+  void fill_fields( const ticcl::word_table&, size_t );
+  void sort_high_second( const ticcl::word_table& );
+  bool test_frequency( const ticcl::word_table&, size_t );
+  bool acceptable( const ticcl::word_table&,
+		   size_t, const map<UChar,bitType>& );
+  UnicodeString get_key( const ticcl::word_table& ) const;
+  uint64_t get_id_key() const;
+  string toString( const ticcl::word_table& ) const;
+  ticcl::word_id id1;
+  ticcl::word_id id2;
   int ld;
   int cls;
   bitType KWC;
   bitType _key1;
   bitType _key2;
+  int ngram_point;
   bool canon;
   bool FLoverlap;
   bool LLoverlap;
-  int ngram_point;
   bool isKHC;
   bool noKHCld;
   bool is_diac;
   bool follow;
 };
 
+using record_table = sharded_table<unordered_map<uint64_t,ld_record>>;
 
-ld_record::ld_record( const UnicodeString& s1,
-		      const UnicodeString& s2,
+
+ld_record::ld_record( ticcl::word_id w1,
+		      ticcl::word_id w2,
 		      bitType key1, bitType key2,
-		      const map<UnicodeString,size_t>& f_map,
-		      const map<UnicodeString,size_t>& low_f_map,
 		      bool is_KHC, bool no_KHCld, bool is_diachrone,
 		      bool following ):
-  str1(s1),
-  str2(s2),
+  id1(w1),
+  id2(w2),
   ld(-1),
   cls(0),
   KWC(0),
   _key1(key1),
   _key2(key2),
+  ngram_point(0),
   canon(false),
   FLoverlap(false),
   LLoverlap(false),
-  ngram_point(0),
   isKHC(is_KHC),
   noKHCld(no_KHCld),
-  is_diac(is_diachrone)
+  is_diac(is_diachrone),
+  follow(following)
 {
-  auto const it1 = f_map.find( s1 );
-  if ( it1 != f_map.end() ){
-    freq1 = it1->second;
-  }
-  else {
-    freq1 = 0;
-  }
-  ls1 = str1;
-  ls1.toLower();
-  auto const lit1 = low_f_map.find( ls1 );
-  if ( lit1 != low_f_map.end() ){
-    low_freq1 = lit1->second;
-  }
-  else {
-    low_freq1 = 0;
-  }
-  auto const it2 = f_map.find( s2 );
-  if ( it2 != f_map.end() ){
-    freq2 = it2->second;
-  }
-  else {
-    freq2 = 0;
-  }
-  ls2 = str2;
-  ls2.toLower();
-  auto const lit2 = low_f_map.find( ls2 );
-  if ( lit2 != low_f_map.end() ){
-    low_freq2 = lit2->second;
-  }
-  else {
-    low_freq2 = 0;
-  }
-  follow = following;
 }
 
-UnicodeString ld_record::get_key() const {
-  return str1 + "~" + str2;
+UnicodeString ld_record::get_key( const ticcl::word_table& words ) const {
+  return words.word( id1 ) + "~" + words.word( id2 );
+}
+
+inline uint64_t id_key( ticcl::word_id id1, ticcl::word_id id2 ){
+  return uint64_t(id1) << 32 | id2;
 }
 
-bool ld_record::handle_the_pair( const UnicodeString& diff_part1,
-				 const UnicodeString& diff_part2,
-				 const map<UnicodeString, size_t>& low_freqMap,
+uint64_t ld_record::get_id_key() const {
+  // the record_store key: the same pair as get_key() but much cheaper.
+  return id_key( id1, id2 );
+}
+
+bool key_less( const ld_record& r1, const ld_record& r2,
+	       const ticcl::word_table& words ){
+  // order records like their get_key() strings would be ordered,
+  // without building those
+  const UnicodeString str1 = words.word( r1.id1 );
+  const UnicodeString str2 = words.word( r2.id1 );
+  int32_t len1 = str1.length();
+  int32_t len2 = str2.length();
+  int32_t len = min( len1, len2 );
+  int8_t res = str1.compare( 0, len, str2, 0, len );
+  if ( res != 0 ){
+    return res < 0;
+  }
+  if ( len1 == len2 ){
+    return words.word( r1.id2 ) < words.word( r2.id2 );
+  }
+  // one str1 is a prefix of the other. So compare the next code unit with
+  // the '~' separator
+  UChar next = ( len1 < len2 ? str2[len] : str1[len] );
+  if ( next == '~' ){
+    // a '~' in a word. rare, take the slow road
+    return r1.get_key( words ) < r2.get_key( words );
+  }
+  return ( len1 < len2 ) == ( u'~' < next );
+}
+
+bool ld_record::handle_the_pair( ticcl::word_id part1,
+				 ticcl::word_id part2,
+				 const ticcl::word_table& words,
 				 size_t freqThreshold,
 				 size_t low_limit,
 				 map<UnicodeString,set<UnicodeString>>& dis_map,
@@ -217,26 +292,22 @@ bool ld_record::handle_the_pair( const UnicodeString& diff_part1,
   //
   // Ok, so we have a pair
   //
+  if ( part1 == ticcl::NO_WORD ) {
+    // can this happen?
+    // anyway: nothing to do
+    return false; // nothing special
+  }
+  const UnicodeString diff_part1 = words.word( part1 );
+  const UnicodeString diff_part2 = words.word( part2 );
   if ( follow ){
 #pragma omp critical (debugout)
     {
       cerr << "ngram candidate: '" << diff_part1 << "~" << diff_part2
-	   << "' in n-grams pair: " << str1 << " # " << str2 << endl;
+	   << "' in n-grams pair: " << words.word( id1 ) << " # "
+	   << words.word( id2 ) << endl;
     }
   }
-  if ( diff_part1.isEmpty() ) {
-    // can this happen?
-    // anyway: nothing to do
-    return false; // nothing special
-  }
-
-  UnicodeString lp = diff_part1;
-  lp.toLower();
-  auto const& entry1 = low_freqMap.find( lp );
-  lp = diff_part2;
-  lp.toLower();
-  if ( entry1 != low_freqMap.end()
-       && entry1->second >= freqThreshold ){
+  if ( words.low_freq( part1 ) >= freqThreshold ){
     if ( follow ){
 #pragma omp critical (debugout)
       {
@@ -252,32 +323,26 @@ bool ld_record::handle_the_pair( const UnicodeString& diff_part1,
   if ( (size_t)diff_part1.length() < low_limit ){
     // a 'short' word
     // count this short words pair AND store the original n-gram pair
-#pragma omp critical (update)
-    {
-      dis_map[disamb_pair].insert( str1 + "~" + str2 );
-      ++dis_count[disamb_pair];
-    }
+    dis_map[disamb_pair].insert( get_key( words ) );
+    ++dis_count[disamb_pair];
     if ( follow ){
 #pragma omp critical (debugout)
       {
 	cerr << "stored: short " << disamb_pair << " and forget about "
-	     << str1 << "~" << str2 << endl;
+	     << get_key( words ) << endl;
       }
     }
   }
   else {
     // count the pair
-#pragma omp critical (update)
-    {
-      ++ngram_count[disamb_pair];
-      // keep pair for later
-    }
+    ++ngram_count[disamb_pair];
+    // keep pair for later
     // signal to discard this ngram (in favor of the unigram within)
     if ( follow ){
 #pragma omp critical (debugout)
       {
 	cerr << "stored: " << disamb_pair << " and forget about "
-	     << str1 << "~" << str2 << endl;
+	     << get_key( words ) << endl;
       }
     }
     //    return false;
@@ -285,56 +350,57 @@ bool ld_record::handle_the_pair( const UnicodeString& diff_part1,
   return true; // forget the original parents
 }
 
-bool ld_record::analyze_ngrams( const map<UnicodeString, size_t>& low_freqMap,
+bool ld_record::analyze_ngrams( const ticcl::word_table& words,
 				size_t freqThreshold,
 				size_t low_limit,
 				map<UnicodeString,set<UnicodeString>>& dis_map,
 				map<UnicodeString, size_t>& dis_count,
 				map<UnicodeString, size_t>& ngram_count ){
+  // the words are split in n-gram parts already, see
+  // ticcl::word_table::split_words()
   ngram_point = 0;
-  vector<UnicodeString> parts1 = TiCC::split_at( str1, ticcl::US_SEPARATOR );
-  vector<UnicodeString> parts2 = TiCC::split_at( str2, ticcl::US_SEPARATOR );
-  if ( parts1.size() == 1 && parts2.size() == 1 ){
+  const size_t size1 = words.part_count( id1 );
+  const size_t size2 = words.part_count( id2 );
+  if ( size1 == 1 && size2 == 1 ){
     if ( follow ){
 #pragma omp critical (debugout)
       {
-	cerr << "ngram candidates: " << parts1[0] << " AND " << parts2[0]
+	cerr << "ngram candidates: " << words.word( words.part( id1, 0 ) )
+	     << " AND " << words.word( words.part( id2, 0 ) )
 	     << " are UNIGRAMS: nothing to do" << endl;
       }
     }
     return false; // nothing special for unigrams
   }
-  UnicodeString diff_part1;
-  UnicodeString diff_part2;
-  if ( parts1.size() == parts2.size() ){
+  ticcl::word_id diff_part1 = ticcl::NO_WORD;
+  ticcl::word_id diff_part2 = ticcl::NO_WORD;
+  if ( size1 == size2 ){
     //
     // search for a pair of 'uncommon' parts in the 2 ngrams.
-    for ( size_t i=0; i < parts1.size(); ++i ){
-      UnicodeString left = parts1[i];
-      left.toLower();
-      UnicodeString right = parts2[i];
-      right.toLower();
-      if ( left == right ){
+    for ( size_t i=0; i < size1; ++i ){
+      const ticcl::word_id left = words.part( id1, i );
+      const ticcl::word_id right = words.part( id2, i );
+      if ( words.lower_id( left ) == words.lower_id( right ) ){
 	// ok, a common part.
       }
-      else if ( diff_part1.isEmpty() ) {
+      else if ( diff_part1 == ticcl::NO_WORD ) {
 	// not yet an uncommon part found. store it.
-	diff_part1 = parts1[i];
-	diff_part2 = parts2[i];
+	diff_part1 = left;
+	diff_part2 = right;
       }
       else {
 	// another uncommon part. these n-grams are too uncommon
 	if ( follow ){
 #pragma omp critical (debugout)
 	  {
-	    cerr << "ngram candidates: " << str1 << " AND " << str2
-		 << " are too different. Discard" << endl;
+	    cerr << "ngram candidates: " << words.word( id1 ) << " AND "
+		 << words.word( id2 ) << " are too different. Discard" << endl;
 	  }
 	}
 	return true; // discard
       }
     }
-    return handle_the_pair( diff_part1, diff_part2, low_freqMap,
+    return handle_the_pair( diff_part1, diff_part2, words,
 			    freqThreshold,
 			    low_limit,
 			    dis_map,
@@ -346,8 +412,21 @@ bool ld_record::analyze_ngrams( const map<UnicodeString, size_t>& low_freqMap,
   }
 }
 
-bool ld_record::ld_is( int wanted ) {
-  ld = ticcl::ldCompare( ls1, ls2 );
+int ld_record::ld_upto( const ticcl::word_table& words, int limit ) const {
+  // we only need the exact LD when it is <= limit, except for KHC records
+  // that are kept anyway. (and when following, for the debug output)
+  if ( ld >= 0 ){
+    // already calculated by ticcl::ldCompareMany()
+    return ld;
+  }
+  if ( follow || ( isKHC && noKHCld ) ){
+    return ticcl::ldCompare( words.lower( id1 ), words.lower( id2 ) );
+  }
+  return ticcl::ldWithin( words.lower( id1 ), words.lower( id2 ), limit );
+}
+
+bool ld_record::ld_is( const ticcl::word_table& words, int wanted ) {
+  ld = ld_upto( words, wanted );
   if ( ld != wanted ){
     if ( !( isKHC && noKHCld ) ){
       if ( follow ){
@@ -369,20 +448,22 @@ bool ld_record::ld_is( int wanted ) {
   if ( follow ){
 #pragma omp critical (debugout)
     {
-      cout << "LD(" << ls1 << "," << ls2 << ")=" << ld << " OK!" << endl;
+      cout << "LD(" << words.lower( id1 ) << "," << words.lower( id2 )
+	   << ")=" << ld << " OK!" << endl;
     }
   }
   return true;
 }
 
-bool ld_record::ld_check( int ldvalue ) {
-  ld = ticcl::ldCompare( ls1, ls2 );
+bool ld_record::ld_check( const ticcl::word_table& words, int ldvalue ) {
+  ld = ld_upto( words, ldvalue );
   if ( ld <= ldvalue ){
     // LD is ok
     if ( follow ){
 #pragma omp critical (debugout)
       {
-	cout << "LD(" << ls1 << "," << ls2 << ") =" << ld
+	cout << "LD(" << words.lower( id1 ) << "," << words.lower( id2 )
+	     << ") =" << ld
 	     << " OK,  <= " << ldvalue << endl;
       }
     }
@@ -413,21 +494,23 @@ bool ld_record::ld_check( int ldvalue ) {
   if ( follow ){
 #pragma omp critical (debugout)
     {
-      cout << "LD(" << ls1 << "," << ls2 << ") =" << ld
+      cout << "LD(" << words.lower( id1 ) << "," << words.lower( id2 )
+	   << ") =" << ld
 	   << " rejected > " << ldvalue << endl;
     }
   }
   return false;
 }
 
-bool ld_record::acceptable( size_t threshold,
+bool ld_record::acceptable( const ticcl::word_table& words,
+			    size_t threshold,
 			    const map<UChar,bitType>& alphabet ) {
-  if ( low_freq1 >= threshold && !is_diac ){
+  if ( words.low_freq( id1 ) >= threshold && !is_diac ){
     // reject correction of lexical words, except for diachrone translations
     if ( follow ){
 #pragma omp critical (debugout)
       {
-	cout << str1 << "~" << str2 << " rejected: Lexical, and not diachrone"
+	cout << get_key( words ) << " rejected: Lexical, and not diachrone"
 	     << endl;
       }
     }
@@ -435,12 +518,13 @@ bool ld_record::acceptable( size_t threshold,
   }
   if ( !alphabet.empty() ){
     // reject non lexically clean Corection Candidates
+    const UnicodeString ls2 = words.lower( id2 );
     for ( int i=0; i < ls2.length(); ++i ){
       if ( alphabet.find( ls2[i] ) == alphabet.end() ){
 	if ( follow ){
 #pragma omp critical (debugout)
 	  {
-	    cout << str1 << "~" << str2 << " rejected: "
+	    cout << get_key( words ) << " rejected: "
 		 << UnicodeString( ls2[i] ) << " not in alphabet" << endl;
 	  }
 	}
@@ -451,14 +535,15 @@ bool ld_record::acceptable( size_t threshold,
   return true;
 }
 
-bool ld_record::test_frequency( size_t threshold ){
+bool ld_record::test_frequency( const ticcl::word_table& words,
+				size_t threshold ){
   // avoid non lexical Correction Candidates
-  if ( low_freq2 < threshold ){
+  if ( words.low_freq( id2 ) < threshold ){
     if ( follow ){
 #pragma omp critical (debugout)
       {
-	cout << str1 << "~" << str2 << " rejected: " << str2
-	     << " is low frequent: " << low_freq2 << endl;
+	cout << get_key( words ) << " rejected: " << words.word( id2 )
+	     << " is low frequent: " << words.low_freq( id2 ) << endl;
       }
     }
     return false;
@@ -466,8 +551,10 @@ bool ld_record::test_frequency( size_t threshold ){
   return true;
 }
 
-void ld_record::sort_high_second(){
+void ld_record::sort_high_second( const ticcl::word_table& words ){
   // order the record with the highest (most probable) freqency as CC
+  const size_t low_freq1 = words.low_freq( id1 );
+  const size_t low_freq2 = words.low_freq( id2 );
   if ( low_freq1 == low_freq2 ){
     //    if ( ::hash(str1,alphabet) > ::hash(str2,alphabet) ){
     if ( _key1 < _key2 ){
@@ -478,14 +565,17 @@ void ld_record::sort_high_second(){
     if ( follow ){
 #pragma omp critical (debugout)
       {
-	cout << "flip " << str1 << "~" << str2 << endl;
+	cout << "flip " << get_key( words ) << endl;
       }
     }
     flip();
   }
 }
 
-void ld_record::fill_fields( size_t freqThreshold ) {
+void ld_record::fill_fields( const ticcl::word_table& words,
+			     size_t freqThreshold ) {
+  const UnicodeString ls1 = words.lower( id1 );
+  const UnicodeString ls2 = words.lower( id2 );
   cls = max(ls1.length(),ls2.length()) - ld;
   LLoverlap = false;
   if ( ls1.length() > 1 && ls2.length() > 1
@@ -498,19 +588,21 @@ void ld_record::fill_fields( size_t freqThreshold ) {
     FLoverlap = true;
   }
   canon = false;
-  if ( low_freq2 >= freqThreshold ){
+  if ( words.low_freq( id2 ) >= freqThreshold ){
     canon = true;
   }
 }
 
-string ld_record::toString() const {
+string ld_record::toString( const ticcl::word_table& words ) const {
   string canon_s = (canon?"1":"0");;
   string FLoverlap_s = (FLoverlap?"1":"0");;
   string LLoverlap_s = (LLoverlap?"1":"0");;
   string KHC = (isKHC?"1":"0");
   stringstream ss;
-  ss << str1 << "~" << freq1 << "~" << low_freq1 << "~"
-     << str2 << "~" << freq2 << "~" << low_freq2 << "~"
+  ss << words.word( id1 ) << "~" << words.freq( id1 ) << "~"
+     << words.low_freq( id1 ) << "~"
+     << words.word( id2 ) << "~" << words.freq( id2 ) << "~"
+     << words.low_freq( id2 ) << "~"
      << KWC << "~" << ld << "~"
      << cls << "~" << canon_s << "~"
      << FLoverlap_s << "~" << LLoverlap_s << "~"
@@ -519,7 +611,7 @@ string ld_record::toString() const {
 }
 
 bool transpose_pair( ld_record& record,
-		     const map<UnicodeString,size_t>& low_freqMap,
+		     const ticcl::word_table& words,
 		     map<UnicodeString,set<UnicodeString>>& dis_map,
 		     map<UnicodeString, size_t>& dis_count,
 		     map<UnicodeString, size_t>& ngram_count,
@@ -530,41 +622,52 @@ bool transpose_pair( ld_record& record,
   if ( following ){
 #pragma omp critical (debugout)
     {
-      cout << "TRANSPOSE: string 1 " << record.str1
-	   << " string 2 " << record.str2 << endl;
+      cout << "TRANSPOSE: string 1 " << words.word( record.id1 )
+	   << " string 2 " << words.word( record.id2 ) << endl;
     }
   }
-  record.sort_high_second();
-  if ( !record.acceptable( freqThreshold, alphabet ) ){
+  record.sort_high_second( words );
+  if ( !record.acceptable( words, freqThreshold, alphabet ) ){
     return false;
   }
-  if ( !record.test_frequency( freqThreshold ) ){
+  if ( !record.test_frequency( words, freqThreshold ) ){
     return false;
   }
-  if ( record.analyze_ngrams( low_freqMap, freqThreshold, low_limit,
+  if ( record.analyze_ngrams( words, freqThreshold, low_limit,
 			      dis_map, dis_count, ngram_count ) ){
     return false;
   }
-  if ( !record.ld_is( 2 ) ){
+  if ( !record.ld_is( words, 2 ) ){
     if ( following ){
 #pragma omp critical (debugout)
       {
-	cout << " LD != 2 " << record.str1 << "," << record.str2 << endl;
+	cout << " LD != 2 " << words.word( record.id1 ) << ","
+	     << words.word( record.id2 ) << endl;
       }
     }
     return false;
   }
-  record.fill_fields( freqThreshold );
+  record.fill_fields( words, freqThreshold );
   if ( following ){
-    cerr << "Transpose result: " << record.toString() << endl;
+    cerr << "Transpose result: " << record.toString( words ) << endl;
   }
   return true;
 }
 
-void handleTranspositions( const set<UnicodeString>& s,
+vector<UnicodeString> lowercase_all( const vector<ticcl::word_id>& s,
+				     const ticcl::word_table& words ){
+  // aliases, so no copying
+  vector<UnicodeString> result;
+  result.reserve( s.size() );
+  for ( const auto& id : s ){
+    result.push_back( words.lower( id ) );
+  }
+  return result;
+}
+
+void handleTranspositions( const vector<ticcl::word_id>& s,
 			   bitType key,
-			   const map<UnicodeString,size_t>& freqMap,
-			   const map<UnicodeString,size_t>& low_freqMap,
+			   const ticcl::word_table& words,
 			   const map<UChar,bitType>& alphabet,
 			   map<UnicodeString,set<UnicodeString>>& dis_map,
 			   map<UnicodeString, size_t>& dis_count,
@@ -574,55 +677,61 @@ void handleTranspositions( const set<UnicodeString>& s,
 			   bool isKHC,
 			   bool noKHCld,
 			   bool isDIAC,
-			   map<UnicodeString,ld_record>& record_store ){
+			   record_table& record_store ){
+  vector<UnicodeString> lows = lowercase_all( s, words );
+  vector<unsigned int> lds( lows.size() );
+  size_t i1 = 0;
   auto it1 = s.begin();
   while ( it1 != s.end() ) {
     bool following = false;
-    UnicodeString str1 = *it1;
-    if ( follow_words.find( str1 ) != follow_words.end() ){
+    if ( !follow_words.empty()
+	 && follow_words.find( words.word( *it1 ) ) != follow_words.end() ){
       following = true;
     }
+    // the LD's of str1 and all the words after it, in one go
+    ticcl::ldCompareMany( lows[i1],
+			  lows.data() + i1 + 1, lows.size() - i1 - 1,
+			  lds.data() );
+    size_t i2 = 0;
     auto it2 = it1;
     ++it2;
     while ( it2 != s.end() ) {
-      UnicodeString str2 = *it2;
-      if ( follow_words.find( str2 ) != follow_words.end() ){
+      if ( !follow_words.empty()
+	   && follow_words.find( words.word( *it2 ) ) != follow_words.end() ){
 	following = true;
       }
-      ld_record record( str1, str2,
+      ld_record record( *it1, *it2,
 			key, key,
-			freqMap, low_freqMap,
 			isKHC, noKHCld, isDIAC, following );
-      if ( transpose_pair( record, low_freqMap,
+      record.ld = lds[i2++];
+      if ( transpose_pair( record, words,
 			   dis_map, dis_count, ngram_count,
 			   freqThreshold, low_limit, alphabet, following ) ){
-	UnicodeString key_string = record.get_key();
-#pragma omp critical (output)
-	{
-	  if ( following ){
-	    if ( record_store.find(key_string) == record_store.end() ){
-	      cerr << "1 insert: " << record.toString() << endl;
+	uint64_t key_string = record.get_id_key();
+	auto res = record_store.emplace( key_string, record );
+	if ( following ){
+#pragma omp critical (debugout)
+	  {
+	    if ( res.second ){
+	      cerr << "1 insert: " << record.toString( words ) << endl;
 	    }
 	    else {
-	      cerr << "1 emplace: "
-		   << record_store.find(key_string)->second.toString() << endl;
+	      cerr << "1 emplace: " << res.first->second.toString( words ) << endl;
 	    }
-	  }
-	  record_store.emplace(key_string,record);
-	  if ( following ){
-	    cerr << "1 emplaced result      : " << record.toString() << endl;
+	    cerr << "1 emplaced result      : " << record.toString( words ) << endl;
 	  }
 	}
       }
       ++it2;
     }
     ++it1;
+    ++i1;
   }
 }
 
 
 bool compare_pair( ld_record& record,
-		   const map<UnicodeString,size_t>& low_freqMap,
+		   const ticcl::word_table& words,
 		   int ldValue,
 		   bitType KWC,
 		   map<UnicodeString,set<UnicodeString>>& dis_map,
@@ -631,18 +740,18 @@ bool compare_pair( ld_record& record,
 		   size_t freqThreshold,
 		   size_t low_limit,
 		   const map<UChar,bitType>& alphabet ){
-  if ( !record.ld_check( ldValue ) ){
+  if ( !record.ld_check( words, ldValue ) ){
     return false;
   }
-  record.sort_high_second();
-  if ( !record.acceptable( freqThreshold, alphabet) ){
+  record.sort_high_second( words );
+  if ( !record.acceptable( words, freqThreshold, alphabet) ){
     return false;
   }
-  if ( record.analyze_ngrams( low_freqMap, freqThreshold, low_limit,
+  if ( record.analyze_ngrams( words, freqThreshold, low_limit,
 			      dis_map, dis_count, ngram_count ) ){
     return false;
   }
-  record.fill_fields( freqThreshold );
+  record.fill_fields( words, freqThreshold );
   record.KWC = KWC;
   return true;
 }
@@ -650,10 +759,9 @@ bool compare_pair( ld_record& record,
 void compareSets( int ldValue,
 		  bitType KWC,
 		  bitType key1,
-		  const set<UnicodeString>& s1,
-		  const set<UnicodeString>& s2,
-		  const map<UnicodeString,size_t>& freqMap,
-		  const map<UnicodeString,size_t>& low_freqMap,
+		  const vector<ticcl::word_id>& s1,
+		  const vector<ticcl::word_id>& s2,
+		  const ticcl::word_table& words,
 		  const map<UChar,bitType>& alphabet,
 		  map<UnicodeString,set<UnicodeString>>& dis_map,
 		  map<UnicodeString, size_t>& dis_count,
@@ -663,56 +771,64 @@ void compareSets( int ldValue,
 		  bool isKHC,
 		  bool noKHCld,
 		  bool isDIAC,
-		  map<UnicodeString,ld_record>& record_store ){
-  // using TiCC::operator<<;
-  // cerr << "set 1 " << s1 << endl;
-  // cerr << "set 2 " << s2 << endl;
+		  record_table& record_store ){
+  const vector<UnicodeString> lows2 = lowercase_all( s2, words );
+  vector<unsigned int> lds;
   auto it1 = s1.begin();
   while ( it1 != s1.end() ) {
     bool following = false;
-    UnicodeString str1 = *it1;
-    if ( follow_words.find( str1 ) != follow_words.end() ){
+    if ( !follow_words.empty()
+	 && follow_words.find( words.word( *it1 ) ) != follow_words.end() ){
       following = true;
     }
     if ( following ){
 #pragma omp critical (debugout)
       {
-	cout << "SET: string 1 " << str1 << endl;
+	cout << "SET: string 1 " << words.word( *it1 ) << endl;
       }
     }
+    ticcl::ldCompareMany( words.lower( *it1 ), lows2, lds );
+    size_t i2 = 0;
     auto it2 = s2.begin();
     while ( it2 != s2.end() ) {
-      UnicodeString str2 = *it2;
-      if ( follow_words.find( str2 ) != follow_words.end() ){
+      if ( !follow_words.empty()
+	   && follow_words.find( words.word( *it2 ) ) != follow_words.end() ){
 	following = true;
       }
       if ( following ){
 #pragma omp critical (debugout)
 	{
-	  cout << "SET: string 2 " << str2 << endl;
+	  cout << "SET: string 2 " << words.word( *it2 ) << endl;
 	}
       }
-      ld_record record( str1, str2,
+      const int ld = lds[i2++];
+      if ( ld > ldValue
+	   && !following
+	   && !( isKHC && noKHCld ) ){
+	// ld_check() would reject it. Don't bother to build a record
+	++it2;
+	continue;
+      }
+      ld_record record( *it1, *it2,
 			key1, KWC + key1,
-			freqMap, low_freqMap,
 			isKHC, noKHCld, isDIAC, following );
-      if ( compare_pair( record, low_freqMap, ldValue, KWC,
+      record.ld = ld;
+      if ( compare_pair( record, words, ldValue, KWC,
 			 dis_map, dis_count, ngram_count,
 			 freqThreshold, low_limit, alphabet ) ){
-	UnicodeString key = record.get_key();
-#pragma omp critical (output)
-	{
-	  if ( following ){
-	    if ( record_store.find(key) == record_store.end() ){
-	      cerr << "2 insert: " << record.toString() << endl;
+	uint64_t key = record.get_id_key();
+	auto res = record_store.emplace( key, record );
+	if ( following ){
+#pragma omp critical (debugout)
+	  {
+	    if ( res.second ){
+	      cerr << "2 insert: " << record.toString( words ) << endl;
 	    }
 	    else {
-	      cerr << "2 emplace: "
-		   << record_store.find(key)->second.toString() << endl
-		   << " By      : " << record.toString() << endl;
+	      cerr << "2 emplace: " << res.first->second.toString( words ) << endl
+		   << " By      : " << record.toString( words ) << endl;
 	    }
 	  }
-	  record_store.emplace(key,record);
 	}
       }
       ++it2;
@@ -723,85 +839,472 @@ void compareSets( int ldValue,
 
 void add_short( ostream& os,
 		const map<UnicodeString,size_t>& dis_count,
-		const map<UnicodeString,size_t>& freqMap,
-		const map<UnicodeString,size_t>& low_freqMap,
+		ticcl::word_table& words,
 		int max_ld, size_t threshold ){
   for ( const auto& [word,point] : dis_count ){
     vector<UnicodeString> parts = TiCC::split_at( word, "~" );
-    ld_record rec( parts[0], parts[1],
+    // the parts of n-grams, interned by split_words() already
+    ld_record rec( words.add_part( parts[0] ), words.add_part( parts[1] ),
 		   0, 0,
-		   freqMap, low_freqMap,
 		   false, false, false, false );
-    if ( !rec.ld_check( max_ld ) ){
+    if ( !rec.ld_check( words, max_ld ) ){
       continue;
     }
-    rec.fill_fields( threshold );
+    rec.fill_fields( words, threshold );
     rec.ngram_point = point;
-    os << rec.toString() << endl;
+    os << rec.toString( words ) << endl;
   }
 }
 
-set<bitType> fill_set( const string& file_name ){
+ticcl::bit_array fill_set( const string& file_name ){
+  if ( ticcl::is_bit_file( file_name ) ){
+    try {
+      return ticcl::load_confusions( file_name );
+    }
+    catch ( const exception& e ){
+      cerr << progname << ": " << e.what() << endl;
+      exit(EXIT_FAILURE);
+    }
+  }
   ifstream is( file_name );
   if ( !is ){
     cerr << progname << ": problem opening " << file_name << endl;
     exit(EXIT_FAILURE);
   }
-  set<bitType> result;
-  UnicodeString hist_line;
-  while ( TiCC::getline( is, hist_line ) ){
-    vector<UnicodeString> v = TiCC::split_at( hist_line, "#" );
-    if ( v.size() != 2 ){
+  vector<bitType> result;
+  string hist_line;
+  vector<string_view> v;
+  while ( getline( is, hist_line ) ){
+    if ( ticcl::split_view( hist_line, '#', v ) != 2 ){
       continue;
     }
-    bitType val = TiCC::stringTo<bitType>(v[0]);
-    result.insert(val);
+    bitType val = ticcl::view_to<bitType>(v[0]);
+    result.push_back(val);
   }
-  return result;
+  return ticcl::bit_array( std::move(result) );
 }
 
-map<bitType,set<UnicodeString>> fill_hashmap( istream& is,
-					      const map<UnicodeString,size_t>& freq_map ){
-  map<bitType,set<UnicodeString>> result;
-  UnicodeString line;
-  while ( TiCC::getline( is, line ) ){
-    vector<UnicodeString> v1 = TiCC::split_at( line, "~" );
-    if ( v1.size() != 2 ){
+struct key_pair {
+  // an anagram value from the index, with its confusion value
+  bitType confusion;
+  bitType key;
+  bool isKHC;
+  bool isDIAC;
+  bool do_trans;
+  // the first line (in file order) with this anagram value handles its
+  // transpositions, with the KHC and DIAC flags of that line
+};
+
+class index_source {
+  // the confusion values and their anagram values, read from a text .index
+  // or .indexNT file, or from a binary index file (see ticcl::index_writer)
+public:
+  explicit index_source( const string& );
+  bool is_binary() const { return _binary != nullptr; };
+  size_t size() const { return _size; };
+  // the size of the index: in bytes for a text file, in confusion values
+  // for a binary one. A text file isn't read to count its lines
+  size_t position() const { return _pos; };
+  // how far the index is read, in the same unit as size()
+  size_t lines() const { return _line_nr; };
+  // the number of lines (or confusion values) read
+  void skip( size_t, size_t );
+  // continue at a position() after the given number of lines()
+  bool next( bitType&, vector<bitType>&, int& );
+  // get the confusion value and anagram values at the next position.
+  // false at the end. For empty or invalid text lines, the anagram
+  // values are empty. Invalid lines are reported and counted
+private:
+  unique_ptr<ticcl::index_reader> _binary;
+  ifstream _text;
+  size_t _size;
+  size_t _pos;
+  size_t _line_nr;
+  string _line;
+  vector<string_view> _parts;
+};
+
+index_source::index_source( const string& file_name ):
+  _size( 0 ),
+  _pos( 0 ),
+  _line_nr( 0 )
+{
+  if ( ticcl::is_index_file( file_name ) ){
+    _binary.reset( new ticcl::index_reader( file_name ) );
+    _size = _binary->size();
+    return;
+  }
+  _text.open( file_name );
+  if ( !_text ){
+    throw runtime_error( "unable to open: " + file_name );
+  }
+  _size = filesystem::file_size( file_name );
+}
+
+void index_source::skip( size_t pos, size_t line_nr ){
+  _pos = min( pos, _size );
+  _line_nr = line_nr;
+  if ( !_binary ){
+    _text.seekg( _pos );
+  }
+}
+
+bool index_source::next( bitType& confusion,
+			 vector<bitType>& values,
+			 int& err_cnt ){
+  values.clear();
+  if ( _binary ){
+    if ( _pos >= _size ){
+      return false;
+    }
+    try {
+      confusion = _binary->values( _pos, values );
+    }
+    catch ( const exception& e ){
+      cerr << progname << ": FATAL ERROR: " << e.what() << endl;
+      exit( EXIT_FAILURE );
+    }
+    ++_pos;
+    ++_line_nr;
+    return true;
+  }
+  if ( !getline( _text, _line ) ){
+    return false;
+  }
+  // the line and its newline, if any
+  _pos = min( _pos + _line.size() + 1, _size );
+  ++_line_nr;
+  if ( verbose > 1 ){
+    cerr << "examine " << _line << endl;
+  }
+  const string_view trimmed = ticcl::trim_view( _line );
+  if ( trimmed.empty() ){
+    return true;
+  }
+  if ( ticcl::split_view( trimmed, '#', _parts ) != 2 ){
+    cerr << progname << ": ERROR in line " << _line_nr
+	 << " of the indexfile: unable to split in 2 parts at #"
+	 << endl << "line was" << endl << trimmed << endl;
+    ++err_cnt;
+    return true;
+  }
+  confusion = ticcl::view_to<bitType>( _parts[0] );
+  const string_view rest = _parts[1];
+  if ( verbose > 1 ){
+    cerr << "extract parts from " << rest << endl;
+  }
+  if ( ticcl::split_view( rest, ',', _parts ) < 1 ){
+    cerr << progname << ": ERROR in line " << _line_nr
+	 << " of indexfile: unable to split in parts separated by ','"
+	 << endl << "line was" << endl << trimmed << endl;
+    ++err_cnt;
+    return true;
+  }
+  values.reserve( _parts.size() );
+  for ( const auto& part : _parts ){
+    values.push_back( ticcl::view_to<bitType>( part ) );
+  }
+  return true;
+}
+
+struct ld_checkpoint {
+  // what is needed to continue an interrupted run: how far the index is
+  // done, and everything collected from it. Saved regularly in
+  // <outputfile>.checkpoint
+  size_t index_size = 0;
+  size_t word_count = 0;
+  int ld_value = 0;
+  size_t index_pos = 0;
+  size_t line_nr = 0;
+  size_t count = 0;
+  int err_cnt = 0;
+};
+
+static const string checkpoint_magic = "TICCL-LDcalc checkpoint 2";
+
+struct ngram_counts {
+  // the n-gram results of one thread. handle_the_pair() only updates the
+  // counts of its own thread, merge_counts() adds them up afterwards
+  map<UnicodeString,set<UnicodeString>> dis_map;
+  map<UnicodeString,size_t> dis_count;
+  map<UnicodeString,size_t> ngram_count;
+};
+
+void merge_counts( vector<ngram_counts>& thread_counts,
+		   map<UnicodeString,set<UnicodeString>>& dis_map,
+		   map<UnicodeString,size_t>& dis_count,
+		   map<UnicodeString,size_t>& ngram_count ){
+  // add the counts of every thread to the totals, and start them afresh
+  for ( auto& local : thread_counts ){
+    for ( auto& [word,ambi_set] : local.dis_map ){
+      dis_map[word].merge( ambi_set );
+    }
+    for ( const auto& [word,cnt] : local.dis_count ){
+      dis_count[word] += cnt;
+    }
+    for ( const auto& [word,cnt] : local.ngram_count ){
+      ngram_count[word] += cnt;
+    }
+    local = ngram_counts();
+  }
+}
+
+void write_count_map( ostream& os,
+		      const map<UnicodeString,size_t>& counts ){
+  os << counts.size() << "\n";
+  for ( const auto& [word,cnt] : counts ){
+    os << word << "\t" << cnt << "\n";
+  }
+}
+
+void write_checkpoint( const string& file_name,
+		       const ld_checkpoint& cp,
+		       const set<bitType>& handledTrans,
+		       const map<UnicodeString,set<UnicodeString>>& dis_map,
+		       const map<UnicodeString,size_t>& dis_count,
+		       const map<UnicodeString,size_t>& ngram_count,
+		       const record_table& record_store ){
+  // write a temporary file and rename it, so there is always a complete
+  // checkpoint, even when we are killed while writing
+  const string tmp_name = file_name + ".tmp";
+  ofstream os( tmp_name );
+  os << checkpoint_magic << "\n"
+     << cp.index_size << " " << cp.word_count << " " << cp.ld_value << " "
+     << cp.index_pos << " " << cp.line_nr << " " << cp.count << " "
+     << cp.err_cnt << "\n";
+  os << handledTrans.size() << "\n";
+  for ( const auto& key : handledTrans ){
+    os << key << "\n";
+  }
+  os << dis_map.size() << "\n";
+  for ( const auto& [word,ambi_set] : dis_map ){
+    os << word;
+    for ( const auto& val : ambi_set ){
+      os << "\t" << val;
+    }
+    os << "\n";
+  }
+  write_count_map( os, dis_count );
+  write_count_map( os, ngram_count );
+  // the records are stored by word id, the strings and frequencies come
+  // from the word table again
+  os << record_store.size() << "\n";
+  record_store.for_each( [&]( const auto& val ){
+      const ld_record& r = val.second;
+      os << r.id1 << " " << r.id2 << " " << r._key1 << " " << r._key2 << " "
+	 << r.ld << " " << r.cls << " " << r.KWC << " " << r.canon << " "
+	 << r.FLoverlap << " " << r.LLoverlap << " " << r.ngram_point << " "
+	 << r.isKHC << " " << r.noKHCld << " " << r.is_diac << " "
+	 << r.follow << "\n";
+    } );
+  os.close();
+  if ( !os || rename( tmp_name.c_str(), file_name.c_str() ) != 0 ){
+    cerr << progname << ": problem writing checkpoint file: " << file_name
+	 << endl;
+  }
+}
+
+bool read_count_map( istream& is,
+		     map<UnicodeString,size_t>& counts ){
+  size_t size = 0;
+  string line;
+  if ( !( is >> size ) || !getline( is, line ) ){
+    return false;
+  }
+  vector<string_view> parts;
+  for ( size_t i=0; i < size; ++i ){
+    if ( !getline( is, line )
+	 || ticcl::split_view( line, '\t', parts ) != 2 ){
+      return false;
+    }
+    counts[ticcl::view_to_unicode( parts[0] )]
+      = ticcl::view_to<size_t>( parts[1] );
+  }
+  return true;
+}
+
+bool read_checkpoint( const string& file_name,
+		      ld_checkpoint& cp,
+		      set<bitType>& handledTrans,
+		      map<UnicodeString,set<UnicodeString>>& dis_map,
+		      map<UnicodeString,size_t>& dis_count,
+		      map<UnicodeString,size_t>& ngram_count,
+		      record_table& record_store ){
+  ifstream is( file_name );
+  string line;
+  if ( !getline( is, line ) || line != checkpoint_magic ){
+    return false;
+  }
+  size_t size = 0;
+  if ( !( is >> cp.index_size >> cp.word_count >> cp.ld_value
+	  >> cp.index_pos >> cp.line_nr >> cp.count >> cp.err_cnt >> size ) ){
+    return false;
+  }
+  for ( size_t i=0; i < size; ++i ){
+    bitType key;
+    if ( !( is >> key ) ){
+      return false;
+    }
+    handledTrans.insert( key );
+  }
+  if ( !( is >> size ) || !getline( is, line ) ){
+    return false;
+  }
+  vector<string_view> parts;
+  for ( size_t i=0; i < size; ++i ){
+    if ( !getline( is, line )
+	 || ticcl::split_view( line, '\t', parts ) < 2 ){
+      return false;
+    }
+    set<UnicodeString>& ambi_set = dis_map[ticcl::view_to_unicode( parts[0] )];
+    for ( size_t j=1; j < parts.size(); ++j ){
+      ambi_set.insert( ticcl::view_to_unicode( parts[j] ) );
+    }
+  }
+  if ( !read_count_map( is, dis_count )
+       || !read_count_map( is, ngram_count ) ){
+    return false;
+  }
+  if ( !( is >> size ) ){
+    return false;
+  }
+  record_store.reserve( size );
+  for ( size_t i=0; i < size; ++i ){
+    ticcl::word_id id1, id2;
+    bitType key1, key2;
+    int ld, cls, ngram_point;
+    bitType KWC;
+    bool canon, FLoverlap, LLoverlap, isKHC, noKHCld, is_diac, follow;
+    if ( !( is >> id1 >> id2 >> key1 >> key2 >> ld >> cls >> KWC >> canon
+	    >> FLoverlap >> LLoverlap >> ngram_point >> isKHC >> noKHCld
+	    >> is_diac >> follow ) ){
+      return false;
+    }
+    ld_record record( id1, id2, key1, key2,
+		      isKHC, noKHCld, is_diac, follow );
+    record.ld = ld;
+    record.cls = cls;
+    record.KWC = KWC;
+    record.canon = canon;
+    record.FLoverlap = FLoverlap;
+    record.LLoverlap = LLoverlap;
+    record.ngram_point = ngram_point;
+    record_store.emplace( record.get_id_key(), record );
+  }
+  return true;
+}
+
+map<bitType,vector<ticcl::word_id>> fill_hashmap( istream& is,
+						  const ticcl::word_table& words ){
+  // the ids of the words per anagram value, ordered on their strings
+  map<bitType,vector<ticcl::word_id>> result;
+  string line;
+  vector<string_view> v1;
+  vector<string_view> v2;
+  while ( getline( is, line ) ){
+    if ( ticcl::split_view( line, '~', v1 ) != 2 ){
       continue;
     }
     else {
-      vector<UnicodeString> v2 = TiCC::split_at( v1[1], "#" );
-      if ( v2.size() < 1 ){
+      if ( ticcl::split_view( v1[1], '#', v2 ) < 1 ){
 	cerr << progname << ": strange line: " << line << endl
 	     << " in anagram hashes file" << endl;
 	exit(EXIT_FAILURE);
       }
       else {
-	bitType key = TiCC::stringTo<bitType>( v1[0] );
+	bitType key = ticcl::view_to<bitType>( v1[0] );
 	for ( size_t i=0; i < v2.size(); ++i ){
-	  auto it = freq_map.find( v2[i] );
-	  if ( it != freq_map.end() ){
+	  UnicodeString word = ticcl::view_to_unicode( v2[i] );
+	  ticcl::word_id id = words.find( word );
+	  if ( id != ticcl::NO_WORD ){
 	    // only store words from the .clean lexicon
-	    result[key].insert( v2[i] );
+	    result[key].push_back( id );
 	  }
 	  else {
 	    if ( verbose > 1 ){
-	      cerr << "skip hash for " << v2[i] << " (not in lexicon)" << endl;
+	      cerr << "skip hash for " << word << " (not in lexicon)" << endl;
 	    }
 	  }
 	}
       }
     }
   }
+  for ( auto& [key,ids] : result ){
+    sort( ids.begin(), ids.end(),
+	  [&words]( ticcl::word_id id1, ticcl::word_id id2 ){
+	    return words.word( id1 ) < words.word( id2 );
+	  } );
+    ids.erase( unique( ids.begin(), ids.end() ), ids.end() );
+  }
   return result;
 }
 
+class anagram_words {
+  // the ids of the lexicon words per anagram value, ordered on their strings.
+  // A text .anahash file is read in a map, a binary anagram index is memory
+  // mapped, and its words are looked up when they are asked for
+public:
+  anagram_words( const string& file_name, const ticcl::word_table& words ):
+    _words( words )
+  {
+    if ( ticcl::is_anagram_index( file_name ) ){
+      _index.reset( new ticcl::anagram_index( file_name ) );
+    }
+    else {
+      ifstream is( file_name );
+      if ( !is ){
+	throw runtime_error( "unable to open: " + file_name );
+      }
+      _map = fill_hashmap( is, words );
+    }
+  }
+  size_t size() const {
+    return _index ? _index->size() : _map.size();
+  }
+  const vector<ticcl::word_id> *find( bitType key,
+				      vector<ticcl::word_id>& ids ) const {
+    // the ids for key, 0 when there are none. For an anagram index they
+    // are collected in ids
+    if ( !_index ){
+      auto it = _map.find( key );
+      return it == _map.end() ? 0 : &it->second;
+    }
+    ids.clear();
+    const size_t pos = _index->find( key );
+    if ( pos == _index->size() ){
+      return 0;
+    }
+    for ( size_t w=_index->first_word( pos );
+	  w < _index->first_word( pos+1 );
+	  ++w ){
+      // only the words from the .clean lexicon
+      UnicodeString word = ticcl::view_to_unicode( _index->word( w ) );
+      ticcl::word_id id = _words.find( word );
+      if ( id != ticcl::NO_WORD ){
+	ids.push_back( id );
+      }
+    }
+    // the index has them in .anahash order already. But be safe
+    sort( ids.begin(), ids.end(),
+	  [this]( ticcl::word_id id1, ticcl::word_id id2 ){
+	    return _words.word( id1 ) < _words.word( id2 );
+	  } );
+    ids.erase( unique( ids.begin(), ids.end() ), ids.end() );
+    return ids.empty() ? 0 : &ids;
+  }
+private:
+  const ticcl::word_table& _words;
+  map<bitType,vector<ticcl::word_id>> _map;
+  unique_ptr<ticcl::anagram_index> _index;
+};
+
 int main( int argc, char **argv ){
   TiCC::CL_Options opts;
   try {
     opts.add_short_options( "vVho:t:" );
     opts.add_long_options( "diac:,hist:,nohld,artifrq:,LD:,hash:,clean:,alph:,"
-			   "index:,help,version,threads:,follow:,low:,high:" );
+			   "index:,help,version,threads:,follow:,low:,high:,"
+			   "checkpoint:,resume" );
     opts.init( argc, argv );
   }
   catch( TiCC::OptionError& e ){
@@ -864,9 +1367,10 @@ int main( int argc, char **argv ){
   opts.extract( "alph", alfabet_file );
   opts.extract( "hist", histconf_file );
   if ( opts.extract( "diac", diaconf_file ) ){
-    if ( !TiCC::match_back( diaconf_file, ".diac" ) ){
+    if ( !TiCC::match_back( diaconf_file, ".diac" )
+	 && !TiCC::match_back( diaconf_file, ".diac.bin" ) ){
       cerr << progname << ": invalid extension for --diac file '"
-	   << diaconf_file << "' (must be .diac) " << endl;
+	   << diaconf_file << "' (must be .diac or .diac.bin) " << endl;
       exit(EXIT_FAILURE);
     }
   }
@@ -903,6 +1407,18 @@ int main( int argc, char **argv ){
     }
   }
 
+  bool do_resume = opts.extract( "resume" );
+  double checkpoint_interval = 600;
+  if ( opts.extract( "checkpoint", value ) ){
+    if ( !TiCC::stringTo(value,checkpoint_interval)
+	 || checkpoint_interval < 0 ){
+      cerr << progname << ": illegal value for --checkpoint (" << value << ")"
+	   << endl;
+      exit( EXIT_FAILURE );
+    }
+  }
+  const string checkpointFile = outFile + ".checkpoint";
+
   int high_limit = 35;
   if ( opts.extract( "high", value ) ){
     if ( !TiCC::stringTo(value,high_limit) ) {
@@ -968,8 +1484,7 @@ int main( int argc, char **argv ){
     exit(EXIT_FAILURE);
   }
   cout << progname << ": reading clean file: " << frequency_file << endl;
-  map<UnicodeString, size_t> freqMap;
-  map<UnicodeString, size_t> low_freqMap;
+  ticcl::word_table words;
   UnicodeString line;
   size_t ign = 0;
   size_t skipped = 0;
@@ -990,24 +1505,27 @@ int main( int argc, char **argv ){
 	continue;
       }
       size_t freq = TiCC::stringTo<size_t>( v1[1] );
-      freqMap[ls] = freq;
-      ls.toLower();
+      ticcl::word_id id = words.add( ls, freq );
+      size_t low_freq = words.low_freq( id );
       if ( freq >= artifreq ){
 	// make sure that the artifrq is counted only once!
-	if ( low_freqMap[ls] == 0 ){
-	  low_freqMap[ls] = freq;
+	if ( low_freq == 0 ){
+	  low_freq = freq;
 	}
 	else {
-	  low_freqMap[ls] += freq-artifreq;
+	  low_freq += freq-artifreq;
 	}
       }
       else {
-	low_freqMap[ls] +=freq;
+	low_freq += freq;
       }
+      words.set_low_freq( id, low_freq );
     }
   }
-  cout << progname << ": read " << freqMap.size()
+  cout << progname << ": read " << words.size()
        << " clean words with frequencies." << endl;
+  // split the n-grams only once, not for every pair they are in
+  words.split_words( ticcl::US_SEPARATOR );
   if ( skipped > 0 ){
     cout << progname << ": skipped " << skipped << " out-of-band words."
 	 << endl;
@@ -1015,7 +1533,7 @@ int main( int argc, char **argv ){
   if ( ign > 0 ){
     cout << progname << ": skipped " << ign << " spaced words in the clean file" << endl;
   }
-  set<bitType> histSet;
+  ticcl::bit_array histSet;
   if ( !histconf_file.empty() ){
     histSet = fill_set( histconf_file );
     if ( histSet.empty() ){
@@ -1027,7 +1545,7 @@ int main( int argc, char **argv ){
       cout << progname << ": read " << histSet.size() << " historical confusions." << endl;
     }
   }
-  set<bitType> diaSet;
+  ticcl::bit_array diaSet;
   if ( !diaconf_file.empty() ){
     diaSet = fill_set( diaconf_file );
     if ( diaSet.empty() ){
@@ -1042,153 +1560,221 @@ int main( int argc, char **argv ){
     }
   }
 
-  ifstream indexf( index_file );
-  if ( !indexf ){
-    cerr << progname << ": problem opening: " << index_file << endl;
+  unique_ptr<index_source> index;
+  try {
+    index.reset( new index_source( index_file ) );
+  }
+  catch ( const exception& e ){
+    cerr << progname << ": problem opening: " << index_file << ": "
+	 << e.what() << endl;
     exit(EXIT_FAILURE);
   }
-  ifstream anaf( anahash_file );
-  if ( !anaf ){
+  unique_ptr<anagram_words> hashMap;
+  try {
+    hashMap.reset( new anagram_words( anahash_file, words ) );
+  }
+  catch ( const exception& e ){
     cerr << progname << ": problem opening anagram hashes file: "
-	 << anahash_file << endl;
+	 << anahash_file << ": " << e.what() << endl;
     exit(EXIT_FAILURE);
   }
-  map<bitType,set<UnicodeString> > hashMap = fill_hashmap( anaf, freqMap );
-  cout << progname << ": read " << hashMap.size() << " hash values" << endl;
+  cout << progname << ": read " << hashMap->size() << " hash values" << endl;
 
   size_t count=0;
   set<bitType> handledTrans;
   map<UnicodeString,set<UnicodeString>> dis_map;
   map<UnicodeString,size_t> dis_count;
   map<UnicodeString,size_t> ngram_count;
-  map<UnicodeString,ld_record> record_store;
-  size_t line_nr = 0;
+  record_table record_store;
   int err_cnt = 0;
 
-  size_t file_lines = 0;
-  while ( TiCC::getline( indexf, line ) ){
-    ++file_lines;
-  }
-  if ( file_lines == 0 ){
+  const size_t index_size = index->size();
+  if ( index_size == 0 ){
     cerr << "the indexfile: '" << index_file
 	 << "' is empty! No further processing possible." << endl;
     exit( EXIT_FAILURE );
   }
-  cout << progname << ": " << file_lines << " character confusion values to be read.\n\t\tWe indicate progress by printing a dot for every 1000 confusion values processed" << endl;
-  indexf.clear();
-  indexf.seekg( 0 );
-  while ( TiCC::getline( indexf, line ) ){
-    if ( err_cnt > 9 ){
-      cerr << progname << ": FATAL ERROR: too many problems in indexfile: "
-	   << index_file << " terminated" << endl;
-      exit( EXIT_FAILURE);
-    }
-    ++line_nr;
-    if ( verbose > 1 ){
-      cerr << "examine " << line << endl;
-    }
-    line = line.trim();
-    if ( line.isEmpty() ){
-      continue;
-    }
-    vector<UnicodeString> parts = TiCC::split_at( line, "#" );
-    if ( parts.size() != 2 ){
-      cerr << progname << ": ERROR in line " << line_nr
-	   << " of the indexfile: unable to split in 2 parts at #"
-	   << endl << "line was" << endl << line << endl;
-      ++err_cnt;
+  if ( index->is_binary() ){
+    cout << progname << ": " << index_size << " character confusion values to be read.";
+  }
+  else {
+    cout << progname << ": " << index_size << " bytes of character confusion values to be read.";
+  }
+  cout << "\n\t\tWe indicate progress by printing a dot for every 1000 confusion values processed" << endl;
+  ld_checkpoint checkpoint;
+  if ( do_resume ){
+    if ( read_checkpoint( checkpointFile, checkpoint, handledTrans,
+			  dis_map, dis_count, ngram_count, record_store ) ){
+      if ( checkpoint.index_size != index_size
+	   || checkpoint.index_pos > index_size
+	   || checkpoint.word_count != words.size()
+	   || checkpoint.ld_value != LDvalue ){
+	cerr << progname << ": the checkpoint in " << checkpointFile
+	     << " was made for other input data" << endl;
+	exit( EXIT_FAILURE );
+      }
+      // skip the index lines that are done already
+      index->skip( checkpoint.index_pos, checkpoint.line_nr );
+      count = checkpoint.count;
+      err_cnt = checkpoint.err_cnt;
+      cout << progname << ": resuming after " << index->lines()
+	   << " lines of the indexfile" << endl;
     }
     else {
-      UnicodeString key_s = parts[0];
-      if ( ++count % 1000 == 0 ){
-	cout << ".";
-	cout.flush();
-	if ( count % 50000 == 0 ){
-	  cout << endl << count << endl;;
+      handledTrans.clear();
+      dis_map.clear();
+      dis_count.clear();
+      ngram_count.clear();
+      record_store.clear();
+      cout << progname << ": no usable checkpoint in " << checkpointFile
+	   << ", starting from the beginning" << endl;
+    }
+  }
+  checkpoint.index_size = index_size;
+  checkpoint.word_count = words.size();
+  checkpoint.ld_value = LDvalue;
+  // a reader (the thread that runs the 'single' block) parses the index and
+  // hands the anagram values of many lines at once to the other threads, in
+  // tasks of task_size values. So all threads stay busy, also when most
+  // lines are short. The order in which the values are handled doesn't
+  // matter: records for the same word pair are equal, the counts add up,
+  // and the reader decides in line order which value does the
+  // transpositions
+  const size_t task_size = 64;
+  const size_t max_pending = 1000000;
+  int max_threads = 1;
+#ifdef HAVE_OPENMP
+  max_threads = omp_get_max_threads();
+#endif
+  vector<ngram_counts> thread_counts( max_threads );
+  auto handle_keys = [&]( const vector<key_pair>& batch ){
+    int thread = 0;
+#ifdef HAVE_OPENMP
+    thread = omp_get_thread_num();
+#endif
+    ngram_counts& local = thread_counts[thread];
+    vector<ticcl::word_id> buf1;
+    vector<ticcl::word_id> buf2;
+    for ( const auto& [mainKey,key,isKHC,isDIAC,do_trans] : batch ){
+      const vector<ticcl::word_id> *ids1 = hashMap->find( key, buf1 );
+      if ( !ids1 ){
+	if ( verbose > 1 ){
+#pragma omp critical (debugout)
+	  cerr << progname << ": WARNING: found a key '" << key
+	       << "' in the input that isn't present in the hashes." << endl;
 	}
+	continue;
       }
-      UnicodeString rest = parts[1];
       if ( verbose > 1 ){
-	cerr << "extract parts from " << rest << endl;
+#pragma omp critical (debugout)
+	cout << "bekijk key1 " << key << endl;
       }
-      parts = TiCC::split_at( rest, "," );
-      if ( parts.size() < 1 ){
-	cerr << progname << ": ERROR in line " << line_nr
-	     << " of indexfile: unable to split in parts separated by ','"
-	     << endl << "line was" << endl << line << endl;
-	++err_cnt;
+      if ( do_trans ){
+	handleTranspositions( *ids1,
+			      key,
+			      words, alphabet,
+			      local.dis_map, local.dis_count,
+			      local.ngram_count,
+			      artifreq, low_limit, isKHC, noKHCld, isDIAC,
+			      record_store );
       }
-      else {
-	bitType mainKey = TiCC::stringTo<bitType>(key_s);
-	bool isKHC = false;
-	if ( histSet.find( mainKey ) != histSet.end() ){
-	  isKHC = true;
-	}
-	bool isDIAC = false;
-	if ( diaSet.find( mainKey ) != diaSet.end() ){
-	  isDIAC = true;
-	}
-#pragma omp parallel for schedule(dynamic,1)
-	for ( size_t i=0; i < parts.size(); ++i ){
-	  UnicodeString keyS = parts[i];
-	  bitType key = TiCC::stringTo<bitType>(keyS);
-	  auto sit1 = hashMap.find(key);
-	  if ( sit1 == hashMap.end() ){
-	    if ( verbose > 1 ){
-#pragma omp critical (debugout)
-	      cerr << progname << ": WARNING: found a key '" << key
-		   << "' in the input that isn't present in the hashes." << endl;
-	    }
-	    continue;
-	  }
-	  if ( verbose > 1 ){
+      const vector<ticcl::word_id> *ids2 = hashMap->find( mainKey+key, buf2 );
+      if ( !ids2 ){
+	if ( verbose > 4 ){
 #pragma omp critical (debugout)
-	    cout << "bekijk key1 " << key << endl;
-	  }
-	  if ( sit1->second.size() > 0
-	       && LDvalue >= 2 ){
-	    bool do_trans = false;
-#pragma omp critical (debugout)
-	    {
-	      auto res = handledTrans.insert( key );
-	      do_trans = res.second == true;
-	    }
-	    if ( do_trans ){
-	      handleTranspositions( sit1->second,
-				    key,
-				    freqMap, low_freqMap, alphabet,
-				    dis_map, dis_count, ngram_count,
-				    artifreq, low_limit, isKHC, noKHCld, isDIAC,
-				    record_store );
-	    }
-	  }
-	  auto sit2 = hashMap.find(mainKey+key);
-	  if ( sit2 == hashMap.end() ){
-	    if ( verbose > 4 ){
-#pragma omp critical (debugout)
-	      cerr << progname << ": WARNING: found a key '" << key
-		   << "' in the input that, when added to '" << mainKey
-		   << "' isn't present in the hashes." << endl;
-	    }
-	    continue;
-	  }
-	  if ( verbose > 1 ){
+	  cerr << progname << ": WARNING: found a key '" << key
+	       << "' in the input that, when added to '" << mainKey
+	       << "' isn't present in the hashes." << endl;
+	}
+	continue;
+      }
+      if ( verbose > 1 ){
 #pragma omp critical (debugout)
-	    cout << "bekijk key2 " << mainKey + key << endl;
+	cout << "bekijk key2 " << mainKey + key << endl;
+      }
+      compareSets( LDvalue, mainKey, key,
+		   *ids1, *ids2,
+		   words, alphabet,
+		   local.dis_map, local.dis_count, local.ngram_count,
+		   artifreq, low_limit, isKHC, noKHCld, isDIAC,
+		   record_store );
+    }
+  };
+  double last_save = ticcl::thread_load::now();
+#pragma omp parallel
+#pragma omp single
+  {
+    bitType mainKey = 0;
+    vector<bitType> keys;
+    vector<key_pair> batch;
+    size_t pending = 0;
+    while ( true ){
+      if ( checkpoint_interval > 0
+	   && ticcl::thread_load::now() - last_save >= checkpoint_interval ){
+	// finish all lines before the next one
+	if ( !batch.empty() ){
+#pragma omp task firstprivate( batch )
+	  handle_keys( batch );
+	  batch.clear();
+	}
+#pragma omp taskwait
+	pending = 0;
+	checkpoint.index_pos = index->position();
+	checkpoint.line_nr = index->lines();
+	checkpoint.count = count;
+	checkpoint.err_cnt = err_cnt;
+	merge_counts( thread_counts, dis_map, dis_count, ngram_count );
+	write_checkpoint( checkpointFile, checkpoint, handledTrans,
+			  dis_map, dis_count, ngram_count, record_store );
+	last_save = ticcl::thread_load::now();
+      }
+      if ( err_cnt > 9 ){
+	cerr << progname << ": FATAL ERROR: too many problems in indexfile: "
+	     << index_file << " terminated" << endl;
+	exit( EXIT_FAILURE);
+      }
+      if ( !index->next( mainKey, keys, err_cnt ) ){
+	break;
+      }
+      if ( keys.empty() ){
+	continue;
+      }
+      if ( ++count % 1000 == 0 ){
+	cout << ".";
+	cout.flush();
+	if ( count % 50000 == 0 ){
+	  cout << endl << count << endl;;
+	}
+      }
+      const bool isKHC = histSet.find( mainKey ) != histSet.end();
+      const bool isDIAC = diaSet.find( mainKey ) != diaSet.end();
+      for ( const auto& key : keys ){
+	// only the reader touches handledTrans, so the lines claim their
+	// anagram values in file order, whatever thread handles them
+	const bool do_trans = LDvalue >= 2 && handledTrans.insert( key ).second;
+	batch.push_back( { mainKey, key, isKHC, isDIAC, do_trans } );
+	if ( batch.size() == task_size ){
+#pragma omp task firstprivate( batch )
+	  handle_keys( batch );
+	  batch.clear();
+	  pending += task_size;
+	  if ( pending >= max_pending ){
+	    // don't run too far ahead of the workers
+#pragma omp taskwait
+	    pending = 0;
 	  }
-	  compareSets( LDvalue, mainKey, key,
-		       sit1->second, sit2->second,
-		       freqMap, low_freqMap, alphabet,
-		       dis_map, dis_count, ngram_count,
-		       artifreq, low_limit, isKHC, noKHCld, isDIAC,
-		       record_store );
 	}
       }
     }
+    if ( !batch.empty() ){
+#pragma omp task firstprivate( batch )
+      handle_keys( batch );
+    }
   }
+  merge_counts( thread_counts, dis_map, dis_count, ngram_count );
   cout << endl << "creating .short file: " << shortFile << endl;
   ofstream shortf( shortFile );
-  add_short( shortf, dis_count, freqMap, low_freqMap, LDvalue, artifreq );
+  add_short( shortf, dis_count, words, LDvalue, artifreq );
   cout << endl << "creating .ambi file: " << ambiFile << endl;
   ofstream amb( ambiFile );
   for ( const auto& [word,ambi_set] : dis_map ){
@@ -1205,11 +1791,20 @@ int main( int argc, char **argv ){
     low_ngramcount[lv] += cnt;
   }
   for ( const auto& [word,dummy] : ngram_count ){
-    if ( record_store.find( word ) != record_store.end() ){
+    record_table::pointer rit = 0;
+    int32_t pos = word.indexOf( u'~' );
+    if ( pos > 0 ){
+      ticcl::word_id id1 = words.find( word.tempSubString( 0, pos ) );
+      ticcl::word_id id2 = words.find( word.tempSubString( pos+1 ) );
+      if ( id1 != ticcl::NO_WORD && id2 != ticcl::NO_WORD ){
+	rit = record_store.find( id_key( id1, id2 ) );
+      }
+    }
+    if ( rit ){
       UnicodeString lv = word;
       lv.toLower();
       assert( low_ngramcount.find( lv ) != low_ngramcount.end() );
-      record_store.find(word)->second.ngram_point += low_ngramcount[lv];
+      rit->second.ngram_point += low_ngramcount[lv];
     }
     else {
       // Ok, our data seems to be incomplete
@@ -1219,9 +1814,19 @@ int main( int argc, char **argv ){
       }
     }
   }
+  vector<const ld_record*> records;
+  records.reserve( record_store.size() );
+  record_store.for_each( [&]( const auto& r ){
+      records.push_back( &r.second );
+    } );
+  sort( records.begin(), records.end(),
+	[&words]( const ld_record *r1, const ld_record *r2 ){
+	  return key_less( *r1, *r2, words );
+	} );
   ofstream os( outFile );
-  for ( const auto& r : record_store ){
-    os << r.second.toString() << endl;
+  for ( const auto& r : records ){
+    os << r->toString( words ) << endl;
   }
+  remove( checkpointFile.c_str() );
   cout << progname << ": Done" << endl;
 }
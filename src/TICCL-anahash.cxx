@@ -29,6 +29,7 @@
 #include <string>
 #include <set>
 #include <map>
+#include <vector>
 #include <iostream>
 #include <fstream>
 
@@ -39,6 +40,9 @@
 #include "ticcl/ticcl_common.h"
 
 #include "config.h"
+#ifdef HAVE_OPENMP
+#include "omp.h"
+#endif
 
 using namespace	std;
 using namespace icu;
@@ -50,6 +54,9 @@ UnicodeString separator;
 bool do_list = false;
 bool do_merge = false;
 bool do_ngrams = false;
+bool do_binary = false;
+int numThreads = 1;
+const size_t chunk_size = 100000;
 
 void create_output( ostream& os,
 		    const map<bitType, set<UnicodeString>>& anagrams ){
@@ -65,6 +72,22 @@ void create_output( ostream& os,
   os << endl;
 }
 
+void create_binary_output( const string& file_name,
+			   const map<bitType, set<UnicodeString>>& anagrams ){
+  // the same as create_output(), as an anagram word index
+  ticcl::anagram_writer aw( file_name );
+  string word;
+  for ( const auto& [val,str_set] : anagrams ){
+    aw.add_key( val );
+    for ( auto const& s : str_set ){
+      word.clear();
+      s.toUTF8String( word );
+      aw.add_word( word );
+    }
+  }
+  aw.close();
+}
+
 UnicodeString filter_tilde_hashtag( const UnicodeString& w ){
   // assume that we cannot break Unicode by replacing # or ~ by _
   UnicodeString result;
@@ -95,12 +118,17 @@ void usage( const string& name ){
   cerr << "\t--clip=<clip> : cut off frequency of the alphabet. (freq 0 is NEVER clipped)" << endl;
   cerr << "\t-h or --help\t this message " << endl;
   cerr << "\t-o 'output_name' write output to file 'output_name'" << endl;
+  cerr << "\t--binary\t also write the output as an anagram word index:" << endl;
+  cerr << "\t\t 'output_name'.idx, which TICCL-LDcalc can memory map." << endl;
   cerr << "\t--artifrq='value': if value > 0, create a separate list of anagram" << endl;
   cerr << "\t\t values that have a lexical frequency < 'artifrq'. (default=0)" << endl;
   cerr << "\t\t for n-grams, only those n-grams are written where at least one" << endl;
   cerr << "\t\t of the composing parts does not have the lexical frequency artifrq. " << endl;
   cerr << "\t--ngrams When the frequency file contains n-grams. (not necessary of equal arity)" << endl;
   cerr << "\t\t we split them into 1-grams and do a frequency lookup per part for the artifreq value." << endl;
+  cerr << "\t-t <threads> or --threads <threads>\n\t\t Number of threads to use for hashing." << endl;
+  cerr << "\t\t If 'threads' has the value \"max\", the number of threads is set to a" << endl;
+  cerr << "\t\t reasonable value. ($OMP_NUM_TREADS - 2)" << endl;
   cerr << "\t-V or --version\t show version " << endl;
   cerr << "\t-v\t verbose (not used yet) " << endl;
 }
@@ -108,23 +136,71 @@ void usage( const string& name ){
 void read_backgound( istream& is,
 		     map<bitType, set<UnicodeString>>& anagrams,
 		     map<UnicodeString,bitType>& merged,
-		     const map<UChar,bitType>& alphabet ){
+		     const ticcl::alphabet_table& alphabet ){
+  vector<UnicodeString> words;
+  vector<UnicodeString> keys;
+  vector<bitType> freqs;
+  vector<bitType> hashes;
   UnicodeString line;
-  while ( TiCC::getline( is, line ) ){
-    vector<UnicodeString> v = TiCC::split_at( line, "\t" );
-    if ( ! ( v.size() == 1 || v.size() == 2 ) ){
-      cerr << "background file in wrong format!" << endl;
-      cerr << "offending line: " << line << endl;
-      exit(EXIT_FAILURE);
+  bool done = false;
+  while ( !done ){
+    done = !TiCC::getline( is, line );
+    if ( !done ){
+      vector<UnicodeString> v = TiCC::split_at( line, "\t" );
+      if ( ! ( v.size() == 1 || v.size() == 2 ) ){
+	cerr << "background file in wrong format!" << endl;
+	cerr << "offending line: " << line << endl;
+	exit(EXIT_FAILURE);
+      }
+      words.push_back( filter_tilde_hashtag( v[0] ) );
+      keys.push_back( v[0] );
+      bitType freq = 1;
+      if ( v.size() == 2 ){
+	freq = TiCC::stringTo<bitType>( v[1] );
+      }
+      freqs.push_back( freq );
+    }
+    if ( words.size() == chunk_size
+	 || ( done && !words.empty() ) ){
+      ticcl::hash_batch( words, alphabet, hashes, numThreads );
+      for ( size_t i=0; i < words.size(); ++i ){
+	anagrams[hashes[i]].insert( words[i] );
+	merged[keys[i]] += freqs[i];
+      }
+      words.clear();
+      keys.clear();
+      freqs.clear();
+    }
+  }
+}
+
+void handle_data( const vector<vector<UnicodeString>>& lines,
+		  const vector<UnicodeString>& words,
+		  map<bitType, set<UnicodeString>>& anagrams,
+		  map<UnicodeString,bitType>& merged,
+		  map<UnicodeString,bitType>& freq_list,
+		  const ticcl::alphabet_table& alphabet,
+		  ostream& os ){
+  vector<bitType> hashes;
+  ticcl::hash_batch( words, alphabet, hashes, numThreads );
+  for ( size_t i=0; i < words.size(); ++i ){
+    const vector<UnicodeString>& v = lines[i];
+    const UnicodeString& word = words[i];
+    bitType h = hashes[i];
+    if ( do_list ){
+      os << v[0] << "\t" << h << endl;
     }
-    UnicodeString word = filter_tilde_hashtag( v[0] );
-    bitType h = ticcl::hash( word, alphabet );
-    anagrams[h].insert( word );
-    bitType freq = 1;
-    if ( v.size() == 2 ){
-      freq = TiCC::stringTo<bitType>( v[1] );
+    else {
+      anagrams[h].insert( word );
+      bitType freq = 1;
+      if ( v.size() == 2 ){
+	freq = TiCC::stringTo<bitType>( v[1] );
+      }
+      freq_list[word] = freq;
+      if ( do_merge && artifreq > 0  ){
+	merged[v[0]] = freq;
+      }
     }
-    merged[v[0]] += freq;
   }
 }
 
@@ -132,31 +208,76 @@ void read_data( istream& is,
 		map<bitType, set<UnicodeString>>& anagrams,
 		map<UnicodeString,bitType>& merged,
 		map<UnicodeString,bitType>& freq_list,
-		const map<UChar,bitType>& alphabet,
+		const ticcl::alphabet_table& alphabet,
 		ostream& os ){
+  // we read and hash the lines in chunks, so the hashing can be spread
+  // over several threads.
+  vector<vector<UnicodeString>> lines;
+  vector<UnicodeString> words;
   UnicodeString line;
   while ( TiCC::getline( is, line ) ){
     // we build a frequency list
     vector<UnicodeString> v = TiCC::split_at( line, "\t" );
     if ( !( v.size() == 1 || v.size() == 2 ) ){
+      // first handle what we have
+      handle_data( lines, words, anagrams, merged, freq_list, alphabet, os );
       cerr << "frequency file in wrong format!" << endl;
       cerr << "offending line: " << line << endl;
       exit(EXIT_FAILURE);
     }
-    UnicodeString word = filter_tilde_hashtag( v[0] );
-    bitType h = ticcl::hash( word, alphabet );
-    if ( do_list ){
-      os << v[0] << "\t" << h << endl;
+    words.push_back( filter_tilde_hashtag( v[0] ) );
+    lines.push_back( v );
+    if ( words.size() == chunk_size ){
+      handle_data( lines, words, anagrams, merged, freq_list, alphabet, os );
+      lines.clear();
+      words.clear();
     }
-    else {
-      anagrams[h].insert( word );
-      bitType freq = 1;
-      if ( v.size() == 2 ){
-	freq = TiCC::stringTo<bitType>( v[1] );
+  }
+  handle_data( lines, words, anagrams, merged, freq_list, alphabet, os );
+}
+
+void add_focus( UnicodeString word,
+		bitType freq,
+		bitType h,
+		const map<UnicodeString,bitType>& freq_list,
+		map<bitType, set<UnicodeString>>& foci ){
+  if ( do_ngrams ){
+    vector<UnicodeString> parts = TiCC::split_at( word, separator );
+    if ( parts.size() > 0 ){
+      // we have an -n-gram
+      bool accept = false;
+      // we split the ngram to see if it is worth adding it to
+      // the foci list.
+      //    - NOT if no part is in the input
+      //    - NOT if all parts are know words.
+      for ( auto const& part: parts ){
+	const auto u_it = freq_list.find( part );
+	if ( u_it != freq_list.end()
+	     && u_it->second < artifreq ){
+	  // so this part IS present in the input, but not in the background
+	  UnicodeString l_part = part;
+	  l_part.toLower();
+	  const auto l_it = freq_list.find(l_part);
+	  if ( l_it == freq_list.end()
+	       || l_it->second < artifreq ){
+	    // the lowercase part is NOT present OR NOT the background
+	    accept = true;
+	  }
+	}
       }
-      freq_list[word] = freq;
-      if ( do_merge && artifreq > 0  ){
-	merged[v[0]] = freq;
+      if ( accept ){
+	word.toLower();
+	foci[h].insert( word );
+      }
+    }
+  }
+  else {
+    if ( freq < artifreq ){
+      word.toLower();
+      const auto l_it = freq_list.find(word);
+      if ( l_it == freq_list.end()
+	   || l_it->second < artifreq ){
+	foci[h].insert(word);
       }
     }
   }
@@ -164,50 +285,23 @@ void read_data( istream& is,
 
 map<bitType, set<UnicodeString>>
 extract_foci( const map<UnicodeString,bitType>& freq_list,
-	      const map<UChar,bitType>& alphabet ){
+	      const ticcl::alphabet_table& alphabet ){
   map<bitType, set<UnicodeString>> foci;
-  for ( const auto& [val,freq] : freq_list ){
-    UnicodeString word = val;
-    bitType h = ticcl::hash( word, alphabet );
-    if ( do_ngrams ){
-      vector<UnicodeString> parts = TiCC::split_at( word, separator );
-      if ( parts.size() > 0 ){
-	// we have an -n-gram
-	bool accept = false;
-	// we split the ngram to see if it is worth adding it to
-	// the foci list.
-	//    - NOT if no part is in the input
-	//    - NOT if all parts are know words.
-	for ( auto const& part: parts ){
-	  const auto u_it = freq_list.find( part );
-	  if ( u_it != freq_list.end()
-	       && u_it->second < artifreq ){
-	    // so this part IS present in the input, but not in the background
-	    UnicodeString l_part = part;
-	    l_part.toLower();
-	    const auto l_it = freq_list.find(l_part);
-	    if ( l_it == freq_list.end()
-		 || l_it->second < artifreq ){
-	      // the lowercase part is NOT present OR NOT the background
-	      accept = true;
-	    }
-	  }
-	}
-	if ( accept ){
-	  word.toLower();
-	  foci[h].insert( word );
-	}
-      }
+  vector<UnicodeString> words;
+  vector<bitType> freqs;
+  vector<bitType> hashes;
+  auto it = freq_list.begin();
+  while ( it != freq_list.end() ){
+    words.clear();
+    freqs.clear();
+    while ( it != freq_list.end() && words.size() < chunk_size ){
+      words.push_back( it->first );
+      freqs.push_back( it->second );
+      ++it;
     }
-    else {
-      if ( freq < artifreq ){
-	word.toLower();
-	const auto l_it = freq_list.find(word);
-	if ( l_it == freq_list.end()
-	     || l_it->second < artifreq ){
-	  foci[h].insert(word);
-	}
-      }
+    ticcl::hash_batch( words, alphabet, hashes, numThreads );
+    for ( size_t i=0; i < words.size(); ++i ){
+      add_focus( words[i], freqs[i], hashes[i], freq_list, foci );
     }
   }
   return foci;
@@ -216,8 +310,8 @@ extract_foci( const map<UnicodeString,bitType>& freq_list,
 int main( int argc, const char *argv[] ){
   TiCC::CL_Options opts;
   try {
-    opts.add_short_options( "vVho:" );
-    opts.add_long_options( "alph:,background:,artifrq:,clip:,help,version,ngrams,list,separator:" );
+    opts.add_short_options( "vVho:t:" );
+    opts.add_long_options( "alph:,background:,artifrq:,clip:,help,version,ngrams,list,separator:,threads:,binary" );
     opts.init( argc, argv );
   }
   catch( TiCC::OptionError& e ){
@@ -263,8 +357,33 @@ int main( int argc, const char *argv[] ){
     }
   }
   do_ngrams = opts.extract( "ngrams" );
+  do_binary = opts.extract( "binary" );
   string out_file_name;
   opts.extract( "o", out_file_name );
+  value = "1";
+  if ( !opts.extract( 't', value ) ){
+    opts.extract( "threads", value );
+  }
+#ifdef HAVE_OPENMP
+  if ( TiCC::lowercase(value) == "max" ){
+    numThreads = omp_get_max_threads() - 2;
+  }
+  else {
+    if ( !TiCC::stringTo(value,numThreads) ) {
+      cerr << "illegal value for -t (" << value << ")" << endl;
+      exit( EXIT_FAILURE );
+    }
+  }
+  if ( numThreads < 1 ){
+    numThreads = 1;
+  }
+#else
+  if ( value != "1" ){
+    cerr << "unable to set number of threads!.\nNo OpenMP support available!"
+	 <<endl;
+    exit(EXIT_FAILURE);
+  }
+#endif
   if ( !opts.empty() ){
     cerr << "unsupported options : " << opts.toString() << endl;
     usage(progname);
@@ -321,7 +440,7 @@ int main( int argc, const char *argv[] ){
     }
   }
 
-  map<UChar,bitType> alphabet;
+  ticcl::alphabet_table alphabet;
   cout << "reading alphabet file: " << alphafile << endl;
   ifstream as( alphafile );
   if ( !ticcl::fillAlphabet( as, alphabet, clip ) ){
@@ -340,6 +459,10 @@ int main( int argc, const char *argv[] ){
       cerr << "option --background not supported for --list" << endl;
       exit( EXIT_FAILURE);
     }
+    if ( do_binary ){
+      cerr << "option --binary not supported for --list" << endl;
+      exit( EXIT_FAILURE);
+    }
     if ( !TiCC::createPath( out_file_name ) ){
       cerr << "unable to open output file: " << out_file_name << endl;
       exit(EXIT_FAILURE);
@@ -404,5 +527,16 @@ int main( int argc, const char *argv[] ){
 
   cout << "generating output file: " << out_file_name << endl;
   create_output( out_stream, anagrams );
+  if ( do_binary ){
+    string index_file_name = out_file_name + ".idx";
+    cout << "generating anagram word index: " << index_file_name << endl;
+    try {
+      create_binary_output( index_file_name, anagrams );
+    }
+    catch ( const exception& e ){
+      cerr << progname << ": " << e.what() << endl;
+      exit(EXIT_FAILURE);
+    }
+  }
   cout << "done!" << endl;
 }
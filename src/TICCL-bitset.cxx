@@ -0,0 +1,213 @@
+/*
+  Copyright (c) 2006 - 2024
+  CLST  - Radboud University
+  ILK   - Tilburg University
+
+  This file is part of ticcltools
+
+  ticcltools is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  ticcltools is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/ticcltools/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+
+*/
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+
+#include "ticcutils/CommandLine.h"
+#include "ticcutils/StringOps.h"
+#include "ticcutils/FileUtils.h"
+#include "ticcl/ticcl_common.h"
+
+#include "config.h"
+
+using namespace	std;
+using ticcl::bitType;
+
+void usage( const string& name ){
+  cerr << "usage: " << name << " [options] --type=<type> FILE" << endl;
+  cerr << "\tconverts an anagram hash, foci or character confusion file into"
+       << endl;
+  cerr << "\ta binary bit file, which TICCL-indexer, TICCL-indexerNT and"
+       << endl;
+  cerr << "\tTICCL-LDcalc can memory map instead of parsing the text." << endl;
+  cerr << "\tOr converts an anagram hash file into an anagram word index for"
+       << endl;
+  cerr << "\tthe --hash option of TICCL-LDcalc." << endl;
+  cerr << "\t--type=<type>\t 'anahash', 'foci', 'confusions' or 'words'" << endl;
+  cerr << "\t\t\t 'words' creates the anagram word index" << endl;
+  cerr << "\t--low=<low>\t skip anagram values of words with less then 'low' characters. (default 5)" << endl;
+  cerr << "\t--high=<high>\t skip anagram values of words with more then 'high' characters. (default 35)" << endl;
+  cerr << "\t\t\t use the same values as for TICCL-indexer." << endl;
+  cerr << "\t--info\t\t show the header of the binary file FILE" << endl;
+  cerr << "\t-o <outputfile>\t name of the output file. (default FILE.bin, or FILE.idx"
+       << endl;
+  cerr << "\t\t\t for an anagram word index)" << endl;
+  cerr << "\t-v\t\t run verbose " << endl;
+  cerr << "\t-V or --version\t show version " << endl;
+  cerr << "\t-h or --help\t this message " << endl;
+}
+
+int show_info( const string& file_name ){
+  if ( ticcl::is_anagram_index( file_name ) ){
+    ticcl::anagram_index index( file_name );
+    cout << file_name << ": anagram word index with " << index.size()
+	 << " anagram values and " << index.word_count() << " words";
+    if ( index.size() > 0 ){
+      cout << " [" << index.key( 0 ) << " - "
+	   << index.key( index.size()-1 ) << "]";
+    }
+    cout << endl;
+    return EXIT_SUCCESS;
+  }
+  ticcl::bit_array values = ticcl::bit_array::map_file( file_name );
+  const ticcl::bit_file_header& h = values.header();
+  cout << file_name << ": " << toString( h.kind ) << " bit file with "
+       << h.count << " values";
+  if ( !values.empty() ){
+    cout << " [" << *values.begin() << " - " << values.back() << "]";
+  }
+  cout << endl;
+  if ( h.kind == ticcl::bit_kind::ANAHASH ){
+    cout << "created with --low=" << h.low << " --high=" << h.high
+	 << ", skipping " << h.skipped << " values" << endl;
+  }
+  return EXIT_SUCCESS;
+}
+
+int main( int argc, char **argv ){
+  TiCC::CL_Options opts;
+  try {
+    opts.add_short_options( "vVho:" );
+    opts.add_long_options( "type:,low:,high:,info,help,version" );
+    opts.init( argc, argv );
+  }
+  catch( TiCC::OptionError& e ){
+    cerr << e.what() << endl;
+    usage( argv[0] );
+    exit( EXIT_FAILURE );
+  }
+  string progname = opts.prog_name();
+  if ( opts.extract('h') || opts.extract("help") ){
+    usage( progname );
+    exit(EXIT_SUCCESS);
+  }
+  if ( opts.extract('V') || opts.extract("version") ){
+    cerr << PACKAGE_STRING << endl;
+    exit(EXIT_SUCCESS);
+  }
+  bool verbose = opts.extract( 'v' );
+  bool info = opts.extract( "info" );
+  string type;
+  opts.extract( "type", type );
+  string out_file;
+  opts.extract( 'o', out_file );
+  int lowValue = 5;
+  int highValue = 35;
+  string value;
+  if ( opts.extract("low", value ) ){
+    if ( !TiCC::stringTo(value,lowValue) ) {
+      cerr << "illegal value for --low (" << value << ")" << endl;
+      exit( EXIT_FAILURE );
+    }
+  }
+  if ( opts.extract("high", value ) ){
+    if ( !TiCC::stringTo(value,highValue) ) {
+      cerr << "illegal value for --high (" << value << ")" << endl;
+      exit( EXIT_FAILURE );
+    }
+  }
+  if ( !opts.empty() ){
+    cerr << "unsupported options : " << opts.toString() << endl;
+    usage(progname);
+    exit(EXIT_FAILURE);
+  }
+  vector<string> fileNames = opts.getMassOpts();
+  if ( fileNames.size() != 1 ){
+    cerr << "exactly one input file is needed" << endl;
+    usage(progname);
+    exit(EXIT_FAILURE);
+  }
+  string file_name = fileNames[0];
+  if ( !TiCC::isFile( file_name ) ){
+    cerr << "unable to open input file: " << file_name << endl;
+    exit(EXIT_FAILURE);
+  }
+  try {
+    if ( info ){
+      return show_info( file_name );
+    }
+    if ( ticcl::is_bit_file( file_name )
+	 || ticcl::is_anagram_index( file_name ) ){
+      cerr << file_name << " is already a binary file" << endl;
+      exit(EXIT_FAILURE);
+    }
+    if ( type == "words" ){
+      if ( out_file.empty() ){
+	out_file = file_name + ".idx";
+      }
+      size_t keys = ticcl::write_anagram_index( file_name, out_file );
+      cout << "wrote the words of " << keys << " anagram values to "
+	   << out_file << endl;
+      return EXIT_SUCCESS;
+    }
+    if ( out_file.empty() ){
+      out_file = file_name + ".bin";
+    }
+    ticcl::bit_array values;
+    ticcl::bit_kind kind;
+    size_t skipped = 0;
+    if ( type == "anahash" ){
+      kind = ticcl::bit_kind::ANAHASH;
+      values = ticcl::load_anahash( file_name, lowValue, highValue,
+				    skipped, verbose );
+    }
+    else if ( type == "foci" ){
+      kind = ticcl::bit_kind::FOCI;
+      values = ticcl::load_bit_set( file_name );
+    }
+    else if ( type == "confusions" ){
+      kind = ticcl::bit_kind::CONFUSIONS;
+      values = ticcl::load_confusions( file_name );
+    }
+    else {
+      cerr << "missing or unsupported --type (" << type << ")" << endl;
+      usage(progname);
+      exit(EXIT_FAILURE);
+    }
+    if ( kind == ticcl::bit_kind::ANAHASH ){
+      ticcl::write_bit_file( out_file, values, kind,
+			     lowValue, highValue, skipped );
+    }
+    else {
+      ticcl::write_bit_file( out_file, values, kind );
+    }
+    cout << endl << "wrote " << values.size() << " " << toString( kind )
+	 << " values to " << out_file << endl;
+    if ( skipped > 0 ){
+      cout << "skipped " << skipped << " out-of-band anagram values" << endl;
+    }
+  }
+  catch( const exception& e ){
+    cerr << progname << ": " << e.what() << endl;
+    exit(EXIT_FAILURE);
+  }
+  return EXIT_SUCCESS;
+}
@@ -63,7 +63,7 @@ unsigned int ld( const UnicodeString& in1,
   return ticcl::ldCompare( s1, s2 );
 }
 
-map<UChar,bitType> alphabet;
+ticcl::alphabet_table alphabet;
 
 class chain_class {
 public:
@@ -123,7 +123,7 @@ UChar diff_char( const UnicodeString& in1, const UnicodeString& in2 ){
   UnicodeString s2 = in2;
   s1.toLower();
   s2.toLower();
-  UChar result = alphabet.begin()->first;
+  UChar result = alphabet.chars().begin()->first;
   for ( int i=0; i < s2.length(); ++i ){
     if ( s1.indexOf(s2[i] ) == -1 ){
       result = s2[i];
@@ -169,7 +169,7 @@ bool chain_class::fill( const UnicodeString& line, bool nounk ){
 	  if ( candidate.length() > a_word.length() ){
 	    UChar diff = diff_char( a_word, candidate );
 	    //	    cerr << "diff=" << diff << endl;
-	    if ( alphabet.find( diff ) == alphabet.end() ){
+	    if ( alphabet.kind( diff ) != ticcl::alphabet_table::CHAR ){
 	      // this will not do. ignore!
 	      cerr << "skip " << a_word << " --> " << candidate << endl;
 	      return true;
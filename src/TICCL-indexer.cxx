@@ -31,12 +31,16 @@
 #include <limits>
 #include <algorithm>
 #include <vector>
+#include <memory>
+#include <functional>
+#include <filesystem>
+#include <cmath>
 #include <climits>
 #include <cstdlib>
 #include <string>
+#include <charconv>
 #include <stdexcept>
 #include <iostream>
-#include <sstream>
 #include <fstream>
 #include "ticcutils/StringOps.h"
 #include "ticcutils/CommandLine.h"
@@ -72,148 +76,722 @@ void usage( const string& name ){
   cerr << "\t--high=<high>\t skip entries from the anagram file longer than "
        << endl;
   cerr << "\t\t\t'high' characters. (default=35)" << endl;
+  cerr << "\t--engine=<merge|probe|foci|window|auto> select the search engine. (default=merge)" << endl;
+  cerr << "\t\t\t 'merge' walks the whole anagram set for every confusion." << endl;
+  cerr << "\t\t\t 'probe' looks up anagram+confusion in a hash table." << endl;
+  cerr << "\t\t\t 'foci' looks up focus+confusion and focus-confusion" << endl;
+  cerr << "\t\t\t in a hash table." << endl;
+  cerr << "\t\t\t 'window' scans the anagram values near every focus" << endl;
+  cerr << "\t\t\t value, like TICCL-indexerNT does." << endl;
+  cerr << "\t\t\t 'auto' times all engines on a sample of the input" << endl;
+  cerr << "\t\t\t and runs the one with the lowest predicted runtime." << endl;
+  cerr << "\t--incremental=<index>\t update the existing 'index' for the new" << endl;
+  cerr << "\t\t\t anagram values in the --hash file, instead of a full run." << endl;
+  cerr << "\t--oldhash=<anahash>\t the anagram hashfile that 'index' was made from." << endl;
+  cerr << "\t--oldfoci=<focifile>\t the foci file that 'index' was made with." << endl;
+  cerr << "\t\t\t (needed when --foci is used)" << endl;
+  cerr << "\t--shard=<i/N>\t only do the i-th of N equal parts of the work," << endl;
+  cerr << "\t\t\t combine the outputs of all parts with TICCL-indexmerge." << endl;
+  cerr << "\t--binary\t write a binary index file, which TICCL-LDcalc reads" << endl;
+  cerr << "\t\t\t faster. (convert it with TICCL-indexmerge)" << endl;
+  cerr << "\t--checkpoint=<secs>\t save the progress of the merge, probe and foci engines" << endl;
+  cerr << "\t\t\t every 'secs' seconds in <outputfile>.checkpoint." << endl;
+  cerr << "\t\t\t (default 600, 0 means never)" << endl;
+  cerr << "\t--resume\t continue an interrupted run from its checkpoint." << endl;
   cerr << "\t-t <threads> or --threads <threads>\n\t\t\t Number of threads to run on." << endl;
   cerr << "\t\t\t If 'threads' has the value \"max\", the number of threads is set to a" << endl;
   cerr << "\t\t\t reasonable value. ($OMP_NUM_TREADS - 2)" << endl;
+  cerr << "\t--grain=<grain>\t the number of confusion values a thread takes" << endl;
+  cerr << "\t\t\t at once from the work queue. (default=1)" << endl;
   cerr << "\t-v\t\t run verbose " << endl;
   cerr << "\t-V or --version\t show version " << endl;
   cerr << "\t-h or --help\t this message " << endl;
 }
 
-struct experiment {
-  set<bitType>::const_iterator start;
-  set<bitType>::const_iterator finish;
+void append_value( string& buf, bitType val ){
+  char digits[24];
+  auto res = to_chars( digits, digits + sizeof(digits), val );
+  buf.append( digits, res.ptr );
+}
+
+void format_result( bitType confusie,
+		    const vector<bitType>& result,
+		    string& buf ){
+  // append the index line for this confusion to buf
+  if ( result.empty() ){
+    return;
+  }
+  size_t start = buf.size();
+  append_value( buf, confusie );
+  buf += '#';
+  bool hit = false;
+  for ( const auto& it : result ){
+    if ( it != result.front() ){
+      buf += ',';
+    }
+    if ( follow_nums.find(it) != follow_nums.end() ){
+#pragma omp critical(debugout)
+      cerr << "Store " << it << " for confusion: " << confusie
+	   << endl;
+      hit = true;
+    }
+    append_value( buf, it );
+  }
+  if ( hit
+       || follow_nums.find(confusie) != follow_nums.end()){
+#pragma omp critical(debugout)
+    cerr << "Stored followed value(s) in: " << buf.substr( start ) << endl;
+  }
+  buf += '\n';
+}
+
+class index_out {
+  // the index file we write: text, or binary with --binary
+public:
+  index_out( const string& name, bool binary, bool resuming, size_t size ){
+    if ( binary ){
+      _binary.reset( new ticcl::index_writer( name, resuming ? size : 0 ) );
+    }
+    else {
+      _text.open( name, resuming ? ios::app : ios::out );
+      if ( !_text ){
+	throw runtime_error( "unable to open: " + name );
+      }
+    }
+  }
+  void format( bitType confusie,
+	       const vector<bitType>& result,
+	       string& buf ) const {
+    // append the output for one confusion to buf
+    if ( !_binary ){
+      format_result( confusie, result, buf );
+    }
+    else if ( !result.empty() ){
+      if ( !follow_nums.empty() ){
+	string line;
+	format_result( confusie, result, line );
+      }
+      ticcl::index_writer::encode( result, buf );
+    }
+  }
+  void write( bitType confusie,
+	      size_t count,
+	      const char *data,
+	      size_t size ){
+    // write what format() made
+    if ( _binary ){
+      _binary->add_encoded( confusie, count, data, size );
+    }
+    else {
+      _text.write( data, size );
+    }
+  }
+  void write_pairs( const vector<ticcl::diff_pair>& pairs, ostream *csf ){
+    if ( _binary ){
+      ticcl::write_index( *_binary, pairs, csf );
+    }
+    else {
+      ticcl::write_index( _text, pairs, csf );
+    }
+  }
+  size_t flush(){
+    // returns the size of the output
+    if ( _binary ){
+      return _binary->flush();
+    }
+    _text.flush();
+    return _text.tellp();
+  }
+  void close(){
+    if ( _binary ){
+      _binary->close();
+    }
+    else {
+      _text.close();
+    }
+  }
+private:
+  ofstream _text;
+  unique_ptr<ticcl::index_writer> _binary;
+};
+
+void close_output( index_out& out, const string& name ){
+  try {
+    out.close();
+  }
+  catch ( const exception& e ){
+    cerr << e.what() << endl;
+    exit(1);
+  }
+  cout << "\nwrote indexes into: " << name << endl;
+}
+
+struct out_slot {
+  // where the output for one confusion value is in the thread buffers
+  int thread;
+  size_t offset;
+  size_t length;
+  size_t count;
 };
 
+void write_block( const vector<out_slot>& slots,
+		  const bitType *confusions,
+		  const vector<string>& buffers,
+		  index_out& out,
+		  ostream *csf ){
+  // write the buffered results in confusion order
+  for ( size_t i=0; i < slots.size(); ++i ){
+    const out_slot& slot = slots[i];
+    if ( slot.count == 0 ){
+      continue;
+    }
+    out.write( confusions[i], slot.count,
+	       buffers[slot.thread].data() + slot.offset, slot.length );
+    if ( csf ){
+      string line;
+      append_value( line, confusions[i] );
+      line += '#';
+      append_value( line, slot.count );
+      line += '\n';
+      *csf << line;
+    }
+  }
+}
 
-void handle_confs( const experiment& exp,
-		   size_t& count,
-		   const set<bitType>& anaSet,
-		   const set<bitType>& focSet,
-		   ostream &of,
-		   ostream *csf ){
-  bitType vorige = 0;
-  bitType totalShift = 0;
-  auto sit = exp.start;
-  while ( sit != exp.finish ){
-    set<bitType> result;
+void show_progress( size_t& count ){
 #pragma omp critical(count)
-    {
-      if ( ++count % 100 == 0 ){
-	cout << ".";
-	cout.flush();
-	if ( count % 5000 == 0 ){
-	  cout << endl << count << endl;
-	}
+  {
+    if ( ++count % 100 == 0 ){
+      cout << ".";
+      cout.flush();
+      if ( count % 5000 == 0 ){
+	cout << endl << count << endl;
       }
     }
-    bitType confusie = *sit;
-    if ( follow_nums.find(confusie) != follow_nums.end() ){
-      cerr << "found confusion value: " << confusie << endl;
-    }
-    bitType diff = confusie - vorige;
-    if ( follow_nums.find(diff) != follow_nums.end() ){
-      cerr << "found a difference value: " << diff << endl;
-    }
-    totalShift += diff;
-    auto it1 = anaSet.begin();
-    auto it2 = it1;
-    while ( it1 != anaSet.end() && it2 != anaSet.end() ){
-      bitType v1 = *it1;
-      bitType v2 = *it2;
-      bitType v2_save = v2;
-      if ( v2 >= totalShift ) {
-	v2 -= totalShift;
+  }
+}
+
+bool in_focus( bitType v1,
+	       bitType v2,
+	       const ticcl::bit_array& focSet ){
+  if ( focSet.empty() ){
+    return true;
+  }
+  // do we have to focus?
+  return !( focSet.find( v1 ) == focSet.end()
+	    && focSet.find( v2 ) == focSet.end() );
+  // not if both values out of focus
+}
+
+void store_value( bitType v1, vector<bitType>& result ){
+  result.push_back( v1 );
+  if ( follow_nums.find(v1) != follow_nums.end() ){
+    cerr << "stored a focus value: " << v1 << endl;
+  }
+}
+
+void handle_conf( bitType confusie,
+		  size_t& count,
+		  const ticcl::bit_array& anaSet,
+		  const ticcl::bit_array& focSet,
+		  vector<bitType>& result ){
+  // the 'merge' engine: walk the whole anagram set in parallel with itself,
+  // shifted over the confusion value
+  result.clear();
+  show_progress( count );
+  if ( follow_nums.find(confusie) != follow_nums.end() ){
+    cerr << "found confusion value: " << confusie << endl;
+  }
+  auto it1 = anaSet.begin();
+  auto it2 = it1;
+  while ( it1 != anaSet.end() && it2 != anaSet.end() ){
+    bitType v1 = *it1;
+    bitType v2 = *it2;
+    bitType v2_save = v2;
+    if ( v2 >= confusie ) {
+      v2 -= confusie;
+    }
+    else {
+      v2 = 0;
+    }
+    if ( v1 == v2 ){
+      if ( in_focus( v1, v2_save, focSet ) ){
+	store_value( v1, result );
       }
-      else {
-	v2 = 0;
+      ++it1;
+      ++it2;
+    }
+    else if ( v1 < v2 ){
+      ++it1;
+    }
+    else {
+      ++it2;
+    }
+  }
+}
+
+void handle_conf_probe( bitType confusie,
+			size_t& count,
+			const ticcl::bit_array& anaVec,
+			const ticcl::bit_hash_set& anaTable,
+			const ticcl::bit_array& focSet,
+			vector<bitType>& result ){
+  // the 'probe' engine: for every anagram value v, look up v + confusion
+  // in a hash table. As anaVec is sorted, we can stop as soon as v +
+  // confusion exceeds the highest anagram value.
+  result.clear();
+  if ( anaVec.empty() ){
+    return;
+  }
+  const bitType max_val = anaVec.back();
+  show_progress( count );
+  if ( follow_nums.find(confusie) != follow_nums.end() ){
+    cerr << "found confusion value: " << confusie << endl;
+  }
+  auto it = anaVec.begin();
+  if ( *it == 0 && confusie > 0 ){
+    // the merge engine clamps v2 - confusie to 0, so a 0 value
+    // always matches with itself. mimic that
+    if ( in_focus( 0, 0, focSet ) ){
+      store_value( 0, result );
+    }
+    ++it;
+  }
+  if ( confusie <= max_val ){
+    const bitType limit = max_val - confusie;
+    for ( ; it != anaVec.end() && *it <= limit; ++it ){
+      bitType v1 = *it;
+      bitType v2 = v1 + confusie;
+      if ( anaTable.contains( v2 )
+	   && in_focus( v1, v2, focSet ) ){
+	store_value( v1, result );
       }
-      if ( v1 == v2 ){
-	// if ( follow_nums.find(v1) != follow_nums.end() ){
-	//   cerr << "found a possible focus value: " << v1 << endl;
-	// }
-	bool foc = true;
-	if ( !focSet.empty() ){
-	  // do we have to focus?
-	  foc = !( focSet.find( v1 ) == focSet.end()
-		   && focSet.find( v2_save ) == focSet.end() );
-	  // not if both values out of focus
-	}
-	if ( foc ){
-	  auto emp = result.emplace(v1);
-	  if ( emp.second
-	       && follow_nums.find(v1) != follow_nums.end() ){
-	    cerr << "stored a focus value: " << v1 << endl;
-	  }
-	}
-	++it1;
-	++it2;
+    }
+  }
+}
+
+ticcl::bit_array present_foci( const ticcl::bit_array& focSet,
+			       const ticcl::bit_array& anaSet ){
+  // the foci values that are anagram values too, the others never match
+  vector<bitType> result;
+  set_intersection( focSet.begin(), focSet.end(),
+		    anaSet.begin(), anaSet.end(),
+		    back_inserter( result ) );
+  return ticcl::bit_array( std::move(result) );
+}
+
+void handle_conf_foci( bitType confusie,
+		       size_t& count,
+		       const ticcl::bit_array& anaVec,
+		       const ticcl::bit_hash_set& anaTable,
+		       const ticcl::bit_array& focSet,
+		       const ticcl::bit_array& present,
+		       vector<bitType>& result ){
+  // the 'foci' engine: a pair (v, v + confusion) is only stored when v or
+  // v + confusion is a focus value. So for every focus value f look up
+  // f + confusion and f - confusion, instead of looking at every anagram
+  // value. Gives the same result as handle_conf_probe, in
+  // |foci| * |confusions| time instead of |anagrams| * |confusions|
+  // 'present' holds the foci values that are in anaVec
+  result.clear();
+  if ( anaVec.empty() ){
+    return;
+  }
+  const bitType max_val = anaVec.back();
+  show_progress( count );
+  if ( follow_nums.find(confusie) != follow_nums.end() ){
+    cerr << "found confusion value: " << confusie << endl;
+  }
+  if ( anaVec.begin()[0] == 0 ){
+    // like the probe engine: a 0 value only matches with itself
+    if ( in_focus( 0, 0, focSet ) ){
+      store_value( 0, result );
+    }
+  }
+  // first the foci that are the lower value of a pair, then the ones that
+  // are the higher value. Both runs are sorted, merge them
+  for ( const auto& f : present ){
+    if ( f != 0
+	 && confusie <= max_val - f
+	 && anaTable.contains( f + confusie ) ){
+      store_value( f, result );
+    }
+  }
+  const size_t mid = result.size();
+  for ( const auto& f : present ){
+    if ( f > confusie
+	 && anaTable.contains( f - confusie ) ){
+      store_value( f - confusie, result );
+    }
+  }
+  inplace_merge( result.begin(), result.begin() + mid, result.end() );
+  result.erase( unique( result.begin(), result.end() ), result.end() );
+}
+
+void run_confusions( const ticcl::bit_array& confSet,
+		     const ticcl::bit_array& anaSet,
+		     const string& engine,
+		     const ticcl::bit_hash_set& anaTable,
+		     const ticcl::bit_array& focSet,
+		     const ticcl::bit_array& present,
+		     int numThreads,
+		     int grain,
+		     ticcl::thread_load& load,
+		     index_out& out,
+		     ostream *csf,
+		     size_t first,
+		     const function<void(size_t)>& block_done ){
+  // the 'merge', 'probe' and 'foci' engines. The last two need anaTable
+  // starts at confusion number 'first', and calls block_done with the
+  // number of confusions done after writing each block
+  // the cost per confusion value varies a lot, so the threads take
+  // 'grain' values at a time, as long as there are any left.
+  // Every thread formats its results in its own buffer. The confusions
+  // are handled in blocks, after each block the results are written in
+  // confusion order. So the output doesn't depend on the number of threads.
+  const bitType *confusions = confSet.begin();
+  const size_t conf_count = confSet.size();
+  const size_t block_size = 64 * grain * numThreads;
+  vector<string> buffers( numThreads );
+  vector<out_slot> slots;
+  size_t count = first;
+  for ( size_t block = first; block < conf_count; block += block_size ){
+    const size_t block_end = min( conf_count, block + block_size );
+    slots.resize( block_end - block );
+#pragma omp parallel for schedule(dynamic,grain) shared( slots, buffers, load )
+    for ( size_t i=block; i < block_end; ++i ){
+      double start = ticcl::thread_load::now();
+      vector<bitType> result;
+      if ( engine == "probe" ){
+	handle_conf_probe( confusions[i], count, anaSet, anaTable,
+			   focSet, result );
       }
-      else if ( v1 < v2 ){
-	++it1;
+      else if ( engine == "foci" ){
+	handle_conf_foci( confusions[i], count, anaSet, anaTable,
+			  focSet, present, result );
       }
       else {
-	++it2;
+	handle_conf( confusions[i], count, anaSet, focSet, result );
       }
+      int thread = 0;
+#ifdef HAVE_OPENMP
+      thread = omp_get_thread_num();
+#endif
+      out_slot& slot = slots[i-block];
+      slot.thread = thread;
+      slot.offset = buffers[thread].size();
+      out.format( confusions[i], result, buffers[thread] );
+      slot.length = buffers[thread].size() - slot.offset;
+      slot.count = result.size();
+      load.add( ticcl::thread_load::now() - start );
     }
-    vorige = confusie;
-    ++sit;
-    if ( !result.empty() ){
-      stringstream ss;
-      ss << confusie << "#";
-      bool hit = false;
-      for ( const auto& it : result ){
-	if ( it != *result.begin() ){
-	  ss << ",";
-	}
-	if ( follow_nums.find(it) != follow_nums.end() ){
-	  cerr << "Store " << it << " for confusion: " << confusie
-	       << endl;
-	  hit = true;
-	}
-	ss << it;
-      }
-      if ( hit
-	   || follow_nums.find(confusie) != follow_nums.end()){
-	cerr << "Stored followed value(s) in: " << ss.str() << endl;
-      }
-#pragma omp critical(update)
-      {
-	of << ss.str() << endl;
-	if ( csf ){
-	  *csf << confusie << "#" << result.size() << endl;
-	}
-      }
+    write_block( slots, confusions + block, buffers, out, csf );
+    for ( auto& buf : buffers ){
+      buf.clear();
+    }
+    block_done( block_end );
+  }
+}
+
+struct index_checkpoint {
+  // the progress of a merge or probe run. It is saved regularly, so an
+  // interrupted run can be continued with --resume
+  string engine;
+  string shard;
+  size_t anagrams = 0;
+  size_t confusions = 0;
+  size_t foci = 0;
+  size_t done = 0;
+  bool has_stats = false;
+  string stats_file;
+  bool binary = false;
+  uintmax_t index_size = 0;
+  uintmax_t stats_size = 0;
+  bool read( const string& );
+  void write( const string& ) const;
+};
+
+static const string checkpoint_magic = "TICCL-indexer checkpoint 2";
+
+bool index_checkpoint::read( const string& file_name ){
+  ifstream is( file_name );
+  string line;
+  if ( !getline( is, line ) || line != checkpoint_magic ){
+    return false;
+  }
+  while ( is >> line ){
+    if ( line == "engine" ) is >> engine;
+    else if ( line == "shard" ) is >> shard;
+    else if ( line == "anagrams" ) is >> anagrams;
+    else if ( line == "confusions" ) is >> confusions;
+    else if ( line == "foci" ) is >> foci;
+    else if ( line == "done" ) is >> done;
+    else if ( line == "has_stats" ) is >> has_stats;
+    else if ( line == "stats_file" ){
+      // the rest of the line, file names may contain spaces
+      is.get();
+      getline( is, stats_file );
+    }
+    else if ( line == "binary" ) is >> binary;
+    else if ( line == "index_size" ) is >> index_size;
+    else if ( line == "stats_size" ) is >> stats_size;
+    else {
+      return false;
+    }
+  }
+  return is.eof() && !engine.empty();
+}
+
+void index_checkpoint::write( const string& file_name ) const {
+  // write a temporary file and rename it, so there is always a complete
+  // checkpoint, even when we are killed while writing
+  const string tmp_name = file_name + ".tmp";
+  ofstream os( tmp_name );
+  os << checkpoint_magic << "\n"
+     << "engine " << engine << "\n"
+     << "shard " << shard << "\n"
+     << "anagrams " << anagrams << "\n"
+     << "confusions " << confusions << "\n"
+     << "foci " << foci << "\n"
+     << "done " << done << "\n"
+     << "has_stats " << has_stats << "\n";
+  if ( has_stats ){
+    os << "stats_file " << stats_file << "\n";
+  }
+  os << "binary " << binary << "\n"
+     << "index_size " << index_size << "\n"
+     << "stats_size " << stats_size << "\n";
+  os.close();
+  if ( !os || rename( tmp_name.c_str(), file_name.c_str() ) != 0 ){
+    cerr << "problem writing checkpoint file: " << file_name << endl;
+  }
+}
+
+bool window_possible( const ticcl::bit_array& anaSet,
+		      const ticcl::bit_array& confSet ){
+  // the merge and probe engines match an anagram value 0 with every
+  // confusion, and every value with confusion 0. The window engine
+  // only finds real differences
+  return !anaSet.empty() && anaSet.begin()[0] != 0
+    && !confSet.empty() && confSet.begin()[0] != 0;
+}
+
+void run_window( const ticcl::bit_array& anaSet,
+		 const ticcl::bit_array& foci,
+		 const ticcl::confusion_filter& filter,
+		 int numThreads,
+		 int grain,
+		 ticcl::thread_load& load,
+		 index_out& out,
+		 ostream *csf ){
+  // the 'window' engine, like TICCL-indexerNT: for every focus value scan
+  // the anagram values around it for confusion differences. The pairs
+  // found are merged and written in confusion order
+  const bitType *values = foci.begin();
+  const size_t foci_count = foci.size();
+  vector<vector<ticcl::diff_pair>> thread_pairs( numThreads );
+  size_t count = 0;
+#pragma omp parallel for schedule(dynamic,grain) shared( thread_pairs, load )
+  for ( size_t i=0; i < foci_count; ++i ){
+    double start = ticcl::thread_load::now();
+    int thread = 0;
+#ifdef HAVE_OPENMP
+    thread = omp_get_thread_num();
+#endif
+    show_progress( count );
+    filter.find_pairs( values[i], anaSet, thread_pairs[thread] );
+    load.add( ticcl::thread_load::now() - start );
+  }
+  vector<ticcl::diff_pair> pairs = ticcl::merge_pairs( thread_pairs );
+  string buf;
+  vector<bitType> result;
+  size_t i = 0;
+  while ( i < pairs.size() ){
+    const bitType confusie = pairs[i].first;
+    result.clear();
+    for ( ; i < pairs.size() && pairs[i].first == confusie; ++i ){
+      result.push_back( pairs[i].second );
+    }
+    buf.clear();
+    out.format( confusie, result, buf );
+    out.write( confusie, result.size(), buf.data(), buf.size() );
+    if ( csf ){
+      string line;
+      append_value( line, confusie );
+      line += '#';
+      append_value( line, result.size() );
+      line += '\n';
+      *csf << line;
     }
   }
 }
 
-size_t init( vector<experiment>& exps,
-	     const set<bitType>& hashes,
-	     size_t threads ){
-  exps.clear();
-  size_t partsize = hashes.size() / threads;
-  if ( partsize < 1 ){
-    experiment e;
-    e.start = hashes.begin();
-    e.finish = hashes.end();
-    exps.push_back( e );
-    return 1;
-  }
-  auto hash_it = hashes.begin();
-  for ( size_t i=0; i < threads; ++i ){
-    experiment e;
-    e.start = hash_it;
-    for ( size_t j=0; j < partsize && hash_it != hashes.end(); ++j ){
-      ++hash_it;
-    }
-    e.finish = hash_it;
-    exps.push_back( e );
-  }
-  if ( hash_it != hashes.end() ){
-    exps[exps.size()-1].finish = hashes.end();
-  }
-  return threads;
+vector<bitType> new_values( const ticcl::bit_array& now,
+			    const ticcl::bit_array& before ){
+  vector<bitType> result;
+  set_difference( now.begin(), now.end(),
+		  before.begin(), before.end(),
+		  back_inserter( result ) );
+  return result;
+}
+
+void run_incremental( const ticcl::bit_array& anaSet,
+		      const ticcl::bit_array& oldAnaSet,
+		      const ticcl::bit_array& focSet,
+		      const ticcl::bit_array& oldFocSet,
+		      const ticcl::confusion_filter& filter,
+		      vector<ticcl::diff_pair>& oldPairs,
+		      int numThreads,
+		      int grain,
+		      ticcl::thread_load& load,
+		      index_out& out,
+		      ostream *csf ){
+  // update an index made from oldAnaSet (and oldFocSet) to anaSet (and
+  // focSet). Only the values that are new, or newly in focus, are scanned
+  // with the window engine. Old pairs are kept when both values are still
+  // there and still in focus. The result is the same as a full run
+  vector<bitType> drivers = new_values( anaSet, oldAnaSet );
+  cout << "found " << drivers.size() << " new anagram values" << endl;
+  if ( !focSet.empty() ){
+    vector<bitType> focused = new_values( focSet, oldFocSet );
+    cout << "found " << focused.size() << " new foci values" << endl;
+    vector<bitType> all;
+    set_union( drivers.begin(), drivers.end(),
+	       focused.begin(), focused.end(),
+	       back_inserter( all ) );
+    drivers.swap( all );
+  }
+  auto keep = [&]( const ticcl::diff_pair& p ){
+    const bitType high = p.second + p.first;
+    return anaSet.find( p.second ) != anaSet.end()
+      && anaSet.find( high ) != anaSet.end()
+      && filter.contains( p.first )
+      && in_focus( p.second, high, focSet );
+  };
+  oldPairs.erase( remove_if( oldPairs.begin(), oldPairs.end(),
+			     [&]( const ticcl::diff_pair& p ){
+			       return !keep( p ); } ),
+		  oldPairs.end() );
+  cout << "kept " << oldPairs.size() << " old index pairs" << endl;
+  // one extra part for the old pairs
+  vector<vector<ticcl::diff_pair>> thread_pairs( numThreads + 1 );
+  size_t count = 0;
+#pragma omp parallel for schedule(dynamic,grain) shared( thread_pairs, load )
+  for ( size_t i=0; i < drivers.size(); ++i ){
+    double start = ticcl::thread_load::now();
+    int thread = 0;
+#ifdef HAVE_OPENMP
+    thread = omp_get_thread_num();
+#endif
+    show_progress( count );
+    vector<ticcl::diff_pair>& pairs = thread_pairs[thread];
+    const size_t first = pairs.size();
+    filter.find_pairs( drivers[i], anaSet, pairs );
+    // with foci, a new value only pairs with values in focus
+    pairs.erase( remove_if( pairs.begin() + first, pairs.end(),
+			    [&]( const ticcl::diff_pair& p ){
+			      return !in_focus( p.second, p.second + p.first,
+						focSet ); } ),
+		 pairs.end() );
+    load.add( ticcl::thread_load::now() - start );
+  }
+  thread_pairs[numThreads].swap( oldPairs );
+  vector<ticcl::diff_pair> result = ticcl::merge_pairs( thread_pairs );
+  out.write_pairs( result, csf );
+}
+
+struct engine_cost {
+  string engine;
+  double seconds;
+};
+
+vector<size_t> sample_positions( size_t size, size_t wanted ){
+  // evenly spread positions in a sorted array, so the sample covers the
+  // whole range of values
+  vector<size_t> result;
+  size_t step = max( size_t(1), size / wanted );
+  for ( size_t i=step/2; i < size; i += step ){
+    result.push_back( i );
+  }
+  return result;
+}
+
+vector<engine_cost> estimate_costs( const ticcl::bit_array& anaSet,
+				    const ticcl::bit_array& focSet,
+				    const ticcl::bit_array& confSet,
+				    const ticcl::bit_array& confs,
+				    const ticcl::bit_array& foci,
+				    const ticcl::bit_array& present,
+				    bool window_ok,
+				    int numThreads,
+				    ticcl::bit_hash_set& anaTable,
+				    unique_ptr<ticcl::confusion_filter>& filter ){
+  // predict the runtime of every engine by timing it on an evenly spread
+  // sample of its work items and scaling that up. Building the probe and
+  // window tables is done for real, they are reused when that engine wins.
+  // 'confs' and 'foci' are the work items, a shard of confSet and focSet
+  vector<engine_cost> result;
+#ifdef HAVE_OPENMP
+  // more threads than processors don't run any faster
+  numThreads = min( numThreads, omp_get_num_procs() );
+#endif
+  vector<size_t> samples = sample_positions( confs.size(), 64 );
+  const double conf_scale = double(confs.size()) / samples.size();
+  size_t count = 0;
+  vector<bitType> found;
+  double start = ticcl::thread_load::now();
+  for ( const auto& i : samples ){
+    handle_conf( confs.begin()[i], count, anaSet, focSet, found );
+  }
+  double secs = ticcl::thread_load::now() - start;
+  result.push_back( { "merge", secs * conf_scale / numThreads } );
+  start = ticcl::thread_load::now();
+  anaTable = ticcl::bit_hash_set( anaSet.begin(), anaSet.end() );
+  double build = ticcl::thread_load::now() - start;
+  count = 0;
+  start = ticcl::thread_load::now();
+  for ( const auto& i : samples ){
+    handle_conf_probe( confs.begin()[i], count, anaSet, anaTable,
+		       focSet, found );
+  }
+  secs = ticcl::thread_load::now() - start;
+  result.push_back( { "probe", build + secs * conf_scale / numThreads } );
+  if ( !focSet.empty() ){
+    count = 0;
+    start = ticcl::thread_load::now();
+    for ( const auto& i : samples ){
+      handle_conf_foci( confs.begin()[i], count, anaSet, anaTable,
+			focSet, present, found );
+    }
+    secs = ticcl::thread_load::now() - start;
+    result.push_back( { "foci", build + secs * conf_scale / numThreads } );
+  }
+  if ( window_ok ){
+    start = ticcl::thread_load::now();
+    filter.reset( new ticcl::confusion_filter( confSet.begin(),
+					       confSet.end() ) );
+    build = ticcl::thread_load::now() - start;
+    vector<size_t> focs = sample_positions( foci.size(), 4096 );
+    const double foci_scale = double(foci.size()) / focs.size();
+    vector<ticcl::diff_pair> pairs;
+    start = ticcl::thread_load::now();
+    for ( const auto& i : focs ){
+      filter->find_pairs( foci.begin()[i], anaSet, pairs );
+    }
+    secs = ticcl::thread_load::now() - start;
+    // the final sort of all pairs, scaled up as n log n
+    start = ticcl::thread_load::now();
+    sort( pairs.begin(), pairs.end() );
+    double sort_secs = ticcl::thread_load::now() - start;
+    if ( pairs.size() > 1 ){
+      const double n = pairs.size();
+      const double total = n * foci_scale;
+      sort_secs *= total * log2( total ) / ( n * log2( n ) );
+    }
+    result.push_back( { "window", build
+			+ ( secs * foci_scale + sort_secs ) / numThreads } );
+  }
+  return result;
 }
 
 int main( int argc, char **argv ){
@@ -221,7 +799,9 @@ int main( int argc, char **argv ){
   try {
     opts.add_short_options( "vVho:t:" );
     opts.add_long_options( "charconf:,hash:,low:,high:,help,version,"
-			   "foci:,threads:,confstats:,follow:" );
+			   "foci:,threads:,confstats:,follow:,engine:,grain:,"
+			   "incremental:,oldhash:,oldfoci:,shard:,resume,"
+			   "checkpoint:,binary" );
     opts.init( argc, argv );
   }
   catch( TiCC::OptionError& e ){
@@ -254,6 +834,21 @@ int main( int argc, char **argv ){
   opts.extract( "charconf", confFile );
   opts.extract( "confstats", confstats_file );
   opts.extract( "foci", fociFile );
+  string oldIndexFile;
+  string oldHashFile;
+  string oldFociFile;
+  if ( opts.extract( "incremental", oldIndexFile ) ){
+    if ( !opts.extract( "oldhash", oldHashFile ) ){
+      cerr << "--incremental needs the --oldhash option" << endl;
+      exit( EXIT_FAILURE );
+    }
+    opts.extract( "oldfoci", oldFociFile );
+    if ( fociFile.empty() != oldFociFile.empty() ){
+      cerr << "--incremental needs both --foci and --oldfoci, or neither"
+	   << endl;
+      exit( EXIT_FAILURE );
+    }
+  }
   opts.extract( 'o', outFile );
   string value;
   while ( opts.extract( "follow", value ) ){
@@ -276,6 +871,47 @@ int main( int argc, char **argv ){
       exit( EXIT_FAILURE );
     }
   }
+  size_t shard = 1;
+  size_t shards = 1;
+  if ( opts.extract( "shard", value ) ){
+    if ( !ticcl::parse_shard( value, shard, shards ) ){
+      cerr << "illegal value for --shard (" << value << ")" << endl;
+      exit( EXIT_FAILURE );
+    }
+  }
+  bool do_resume = opts.extract( "resume" );
+  const bool binary = opts.extract( "binary" );
+  double checkpoint_interval = 600;
+  if ( opts.extract( "checkpoint", value ) ){
+    if ( !TiCC::stringTo(value,checkpoint_interval)
+	 || checkpoint_interval < 0 ){
+      cerr << "illegal value for --checkpoint (" << value << ")" << endl;
+      exit( EXIT_FAILURE );
+    }
+  }
+  if ( do_resume && !oldIndexFile.empty() ){
+    cerr << "--incremental and --resume can't be combined" << endl;
+    exit( EXIT_FAILURE );
+  }
+  if ( shards > 1 && !oldIndexFile.empty() ){
+    cerr << "--incremental and --shard can't be combined" << endl;
+    exit( EXIT_FAILURE );
+  }
+  int grain = 1;
+  if ( opts.extract( "grain", value ) ){
+    if ( !TiCC::stringTo(value,grain) || grain < 1 ) {
+      cerr << "illegal value for --grain (" << value << ")" << endl;
+      exit( EXIT_FAILURE );
+    }
+  }
+  string engine = "merge";
+  if ( opts.extract( "engine", engine ) ){
+    if ( engine != "merge" && engine != "probe" && engine != "foci"
+	 && engine != "window" && engine != "auto" ){
+      cerr << "illegal value for --engine (" << engine << ")" << endl;
+      exit( EXIT_FAILURE );
+    }
+  }
   int numThreads=1;
   value = "1";
   if ( !opts.extract( 't', value ) ){
@@ -283,10 +919,10 @@ int main( int argc, char **argv ){
   }
 #ifdef HAVE_OPENMP
   if ( TiCC::lowercase(value) == "max" ){
-    numThreads = omp_get_max_threads() - 2;
+    numThreads = max( 1, omp_get_max_threads() - 2 );
   }
   else {
-    if ( !TiCC::stringTo(value,numThreads) ) {
+    if ( !TiCC::stringTo(value,numThreads) || numThreads < 1 ) {
       cerr << "illegal value for -t (" << value << ")" << endl;
       exit( EXIT_FAILURE );
     }
@@ -312,14 +948,15 @@ int main( int argc, char **argv ){
     exit(1);
   }
 
-  set<bitType> focSet;
+  ticcl::bit_array focSet;
   if ( !fociFile.empty() ){
-    ifstream foc( fociFile );
-    if ( !foc ){
-      cerr << "problem opening foci file: " << fociFile << endl;
+    try {
+      focSet = ticcl::load_bit_set( fociFile );
+    }
+    catch ( const exception& e ){
+      cerr << "problem reading foci file: " << e.what() << endl;
       exit(1);
     }
-    focSet = ticcl::read_bit_set( foc );
     cout << "read " << focSet.size() << " foci values" << endl;
   }
 
@@ -335,54 +972,291 @@ int main( int argc, char **argv ){
     outFile += ".index";
   }
 
-  ofstream of( outFile );
-  if ( !of ){
-    cerr << "problem opening outputfile: " << outFile << endl;
+  if ( outFile == oldIndexFile ){
+    cerr << "the output file must differ from the --incremental index file"
+	 << endl;
     exit(1);
   }
+  // the merge, probe and foci engines save their progress in a checkpoint
+  // file. With --resume the outputs are cut back to the last checkpoint and
+  // extended from there
+  const string checkpoint_file = outFile + ".checkpoint";
+  const string stats_path = confstats_file.empty() ? ""
+    : filesystem::absolute( confstats_file ).string();
+  index_checkpoint checkpoint;
+  bool resuming = false;
+  if ( do_resume ){
+    if ( checkpoint.read( checkpoint_file ) ){
+      if ( checkpoint.has_stats != !confstats_file.empty() ){
+	cerr << "the checkpoint in " << checkpoint_file
+	     << ( checkpoint.has_stats ? " needs" : " was made without" )
+	     << " the --confstats option" << endl;
+	exit(1);
+      }
+      if ( checkpoint.stats_file != stats_path ){
+	cerr << "the checkpoint in " << checkpoint_file
+	     << " was made with --confstats=" << checkpoint.stats_file << endl;
+	exit(1);
+      }
+      if ( checkpoint.binary != binary ){
+	cerr << "the checkpoint in " << checkpoint_file
+	     << ( checkpoint.binary ? " needs" : " was made without" )
+	     << " the --binary option" << endl;
+	exit(1);
+      }
+      resuming = true;
+      cout << "resuming after " << checkpoint.done
+	   << " character confusion values" << endl;
+    }
+    else {
+      cout << "no checkpoint found in " << checkpoint_file
+	   << ", starting from the beginning" << endl;
+    }
+  }
+  unique_ptr<index_out> out;
   ofstream *csf = 0;
-  if ( !confstats_file.empty() ){
-    csf = new ofstream( confstats_file );
-    if ( !csf ){
-      cerr << "problem opening outputfile: " << confstats_file << endl;
+  auto open_outputs = [&](){
+    // only called when the input is checked, so a checkpoint that doesn't
+    // fit leaves the outputs as they are
+    if ( resuming ){
+      try {
+	if ( !binary ){
+	  // the index_writer cuts a binary index back itself
+	  filesystem::resize_file( outFile, checkpoint.index_size );
+	}
+	if ( checkpoint.has_stats ){
+	  filesystem::resize_file( confstats_file, checkpoint.stats_size );
+	}
+      }
+      catch ( const exception& e ){
+	cerr << "unable to resume from " << checkpoint_file << ": "
+	     << e.what() << endl;
+	exit(1);
+      }
+    }
+    try {
+      out.reset( new index_out( outFile, binary, resuming,
+				checkpoint.index_size ) );
+    }
+    catch ( const exception& e ){
+      cerr << "problem opening outputfile: " << e.what() << endl;
       exit(1);
     }
-  }
+    if ( !confstats_file.empty() ){
+      csf = new ofstream( confstats_file, resuming ? ios::app : ios::out );
+      if ( !csf ){
+	cerr << "problem opening outputfile: " << confstats_file << endl;
+	exit(1);
+      }
+    }
+  };
   cout << "reading corpus word anagram hash values" << endl;
-  ifstream ana( anahashFile );
   size_t skipped = 0;
-  set<bitType> anaSet = ticcl::read_anahash( ana,
-					     lowValue,
-					     highValue,
-					     skipped,
-					     verbose );
+  ticcl::bit_array anaSet;
+  try {
+    anaSet = ticcl::load_anahash( anahashFile,
+				  lowValue,
+				  highValue,
+				  skipped,
+				  verbose );
+  }
+  catch ( const exception& e ){
+    cerr << "problem reading corpus anagram hashfile: " << e.what() << endl;
+    exit(1);
+  }
   cout << "read " << anaSet.size() << " corpus anagram values" << endl;
   cout << "skipped " << skipped << " out-of-band corpus anagram values" << endl;
 
   cout << "reading character confusion anagram values" << endl;
-  ifstream conf( confFile );
-  set<bitType> confSet = ticcl::read_confusions( conf );
+  ticcl::bit_array confSet;
+  try {
+    confSet = ticcl::load_confusions( confFile );
+  }
+  catch ( const exception& e ){
+    cerr << "problem reading charconfusion file: " << e.what() << endl;
+    exit(1);
+  }
   cout << endl << "read " << confSet.size()
        << " character confusion anagram values" << endl;
 
-  vector<experiment> experiments;
-  size_t expsize = init( experiments, confSet, numThreads );
 #ifdef HAVE_OPENMP
-  omp_set_num_threads( expsize );
-  cout << "running on " << expsize << " threads." << endl;
+  omp_set_num_threads( numThreads );
+  cout << "running on " << numThreads << " threads." << endl;
 #endif
 
+  if ( !oldIndexFile.empty() ){
+    if ( !window_possible( anaSet, confSet ) ){
+      cerr << "incremental indexing can't handle anagram or confusion value 0"
+	   << endl;
+      exit( EXIT_FAILURE );
+    }
+    ticcl::bit_array oldAnaSet;
+    ticcl::bit_array oldFocSet;
+    vector<ticcl::diff_pair> oldPairs;
+    try {
+      size_t old_skipped = 0;
+      oldAnaSet = ticcl::load_anahash( oldHashFile,
+				       lowValue,
+				       highValue,
+				       old_skipped,
+				       false );
+      if ( !oldFociFile.empty() ){
+	oldFocSet = ticcl::load_bit_set( oldFociFile );
+      }
+      oldPairs = ticcl::load_index( oldIndexFile );
+    }
+    catch ( const exception& e ){
+      cerr << "problem reading the old index data: " << e.what() << endl;
+      exit(1);
+    }
+    cout << "read " << oldPairs.size() << " index pairs from "
+	 << oldIndexFile << endl;
+    open_outputs();
+    ticcl::confusion_filter filter( confSet.begin(), confSet.end() );
+    ticcl::thread_load load( numThreads );
+    run_incremental( anaSet, oldAnaSet, focSet, oldFocSet, filter,
+		     oldPairs, numThreads, grain, load, *out, csf );
+    cout << endl;
+    load.report( cout );
+    close_output( *out, outFile );
+    if ( csf ){
+      cout << "wrote confusion statistics into: " << confstats_file << endl;
+      csf->close();
+      delete csf;
+    }
+    return EXIT_SUCCESS;
+  }
 
-  cout << "processing all character confusion values" << endl;
-  size_t count = 0;
-#pragma omp parallel for shared( experiments, of, csf )
-  for ( size_t i=0; i < expsize; ++i ){
-    handle_confs( experiments[i], count, anaSet, focSet, of, csf );
+  // with --shard, only a slice of the confusions (for the merge, probe and
+  // foci engines) or of the foci (for the window engine) is handled here
+  ticcl::bit_array confShard;
+  ticcl::bit_array fociShard;
+  if ( shards > 1 ){
+    confShard = ticcl::shard_of( confSet, shard, shards );
+    fociShard = ticcl::shard_of( focSet.empty() ? anaSet : focSet,
+				 shard, shards );
+    cout << "shard " << shard << "/" << shards << ": "
+	 << confShard.size() << " confusion values, "
+	 << fociShard.size() << " foci values" << endl;
+  }
+  const ticcl::bit_array& confs = ( shards > 1 ) ? confShard : confSet;
+  const ticcl::bit_array& foci = ( shards > 1 ) ? fociShard
+    : ( focSet.empty() ? anaSet : focSet );
+  ticcl::bit_hash_set anaTable;
+  unique_ptr<ticcl::confusion_filter> filter;
+  const bool window_ok = window_possible( anaSet, confSet );
+  if ( engine == "foci" && focSet.empty() ){
+    cout << "no foci file given, the foci engine is the probe engine then"
+	 << endl;
+    engine = "probe";
+  }
+  if ( engine == "window" && !window_ok ){
+    cerr << "the window engine can't handle anagram or confusion value 0"
+	 << endl;
+    exit( EXIT_FAILURE );
+  }
+  const string shard_s = to_string( shard ) + "/" + to_string( shards );
+  if ( resuming ){
+    if ( checkpoint.shard != shard_s
+	 || checkpoint.anagrams != anaSet.size()
+	 || checkpoint.confusions != confs.size()
+	 || checkpoint.foci != focSet.size() ){
+      cerr << "the checkpoint in " << checkpoint_file
+	   << " was made for other input data or another shard" << endl;
+      exit(1);
+    }
+    engine = checkpoint.engine;
+  }
+  open_outputs();
+  ticcl::bit_array present;
+  if ( engine == "foci" || engine == "auto" ){
+    present = present_foci( focSet, anaSet );
+  }
+  double predicted = 0;
+  if ( engine == "auto" ){
+    cout << "estimating the cost of the engines" << endl;
+    vector<engine_cost> costs = estimate_costs( anaSet, focSet, confSet,
+						confs, foci, present,
+						window_ok, numThreads,
+						anaTable, filter );
+    engine_cost best = costs.front();
+    for ( const auto& cost : costs ){
+      cout << "predicted runtime of the " << cost.engine << " engine: "
+	   << cost.seconds << "s" << endl;
+      if ( cost.seconds < best.seconds ){
+	best = cost;
+      }
+    }
+    engine = best.engine;
+    predicted = best.seconds;
+  }
+  const double start = ticcl::thread_load::now();
+  ticcl::thread_load load( numThreads );
+  if ( engine == "window" ){
+    if ( !filter ){
+      filter.reset( new ticcl::confusion_filter( confSet.begin(),
+						 confSet.end() ) );
+    }
+    cout << "using the window engine ("
+	 << ticcl::toString( ticcl::ld_best_kernel() ) << ")" << endl;
+    cout << "processing all foci values" << endl;
+    run_window( anaSet, foci, *filter, numThreads, grain, load, *out, csf );
+  }
+  else {
+    if ( engine == "probe" || engine == "foci" ){
+      if ( engine == "probe" ){
+	cout << "using the hash probe engine" << endl;
+      }
+      else {
+	cout << "using the foci probe engine" << endl;
+      }
+      if ( anaTable.empty() ){
+	anaTable = ticcl::bit_hash_set( anaSet.begin(), anaSet.end() );
+      }
+    }
+    cout << "processing all character confusion values" << endl;
+    if ( !resuming ){
+      checkpoint.engine = engine;
+      checkpoint.shard = shard_s;
+      checkpoint.anagrams = anaSet.size();
+      checkpoint.confusions = confs.size();
+      checkpoint.foci = focSet.size();
+      checkpoint.has_stats = csf != 0;
+      checkpoint.stats_file = stats_path;
+      checkpoint.binary = binary;
+    }
+    double last_save = ticcl::thread_load::now();
+    auto save = [&]( size_t done ){
+      if ( checkpoint_interval <= 0
+	   || done == confs.size()
+	   || ticcl::thread_load::now() - last_save < checkpoint_interval ){
+	return;
+      }
+      checkpoint.index_size = out->flush();
+      if ( csf ){
+	csf->flush();
+	checkpoint.stats_size = csf->tellp();
+      }
+      checkpoint.done = done;
+      checkpoint.write( checkpoint_file );
+      last_save = ticcl::thread_load::now();
+    };
+    run_confusions( confs, anaSet, engine, anaTable, focSet, present,
+		    numThreads, grain, load, *out, csf,
+		    resuming ? checkpoint.done : 0, save );
+  }
+  cout << endl;
+  load.report( cout );
+  if ( predicted > 0 ){
+    cout << "actual runtime of the " << engine << " engine: "
+	 << ticcl::thread_load::now() - start << "s (predicted "
+	 << predicted << "s)" << endl;
   }
-  cout << "\nwrote indexes into: " << outFile << endl;
+  close_output( *out, outFile );
   if ( csf ){
     cout << "wrote confusion statistics into: " << confstats_file << endl;
     csf->close();
     delete csf;
   }
+  remove( checkpoint_file.c_str() );
 }
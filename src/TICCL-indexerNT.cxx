@@ -29,7 +29,8 @@
 #include <limits>
 #include <algorithm>
 #include <vector>
-#include <map>
+#include <iterator>
+#include <memory>
 #include <climits>
 #include <cstdlib>
 #include <string>
@@ -52,6 +53,7 @@
 using namespace std;
 using namespace icu;
 using ticcl::bitType;
+using ticcl::diff_pair;
 set<bitType> follow_nums;
 
 void usage( const string& name ){
@@ -73,138 +75,121 @@ void usage( const string& name ){
   cerr << "\t-t <threads> or --threads <threads>\n\t\t\t Number of threads to run on." << endl;
   cerr << "\t\t\t If 'threads' has the value \"max\", the number of threads is set to a" << endl;
   cerr << "\t\t\t reasonable value. (OMP_NUM_TREADS - 2)" << endl;
+  cerr << "\t--engine=<engine>\t the search strategy: 'window' (default) or" << endl;
+  cerr << "\t\t\t 'walk'. 'window' scans the anagram values near every focus" << endl;
+  cerr << "\t\t\t with a SIMD confusion filter, 'walk' looks up every" << endl;
+  cerr << "\t\t\t difference in the confusion set." << endl;
+  cerr << "\t--grain=<grain>\t the number of foci values a thread takes" << endl;
+  cerr << "\t\t\t at once from the work queue. (default=1)" << endl;
+  cerr << "\t--shard=<i/N>\t only handle the i-th of N equal parts of the foci," << endl;
+  cerr << "\t\t\t combine the outputs of all parts with TICCL-indexmerge." << endl;
+  cerr << "\t--binary\t write a binary index file, which TICCL-LDcalc reads" << endl;
+  cerr << "\t\t\t faster. (convert it with TICCL-indexmerge)" << endl;
   cerr << "\t-v\t\t run verbose " << endl;
   cerr << "\t-V or --version\t show version " << endl;
   cerr << "\t-h\t\t this message " << endl;
 }
 
-struct experiment {
-  set<bitType>::const_iterator start;
-  set<bitType>::const_iterator finish;
-};
-
-size_t init( vector<experiment>& exps,
-	     const set<bitType>& hashes,
-	     size_t threads ){
-  exps.clear();
-  size_t partsize = hashes.size() / threads;
-  if ( partsize < 1 ){
-    experiment e;
-    e.start = hashes.begin();
-    e.finish = hashes.end();
-    exps.push_back( e );
-    return 1;
-  }
-  auto s = hashes.begin();
-  for ( size_t i=0; i < threads; ++i ){
-    experiment e;
-    e.start = s;
-    for ( size_t j=0; j < partsize; ++j ){
-      ++s;
+void show_progress( size_t& count ){
+  size_t done;
+#pragma omp atomic capture
+  done = ++count;
+  if ( done % 100 == 0 ){
+#pragma omp critical(progress)
+    {
+      cout << ".";
+      cout.flush();
+      if ( done % 5000 == 0 ){
+	cout << endl << done << endl;;
+      }
     }
-    e.finish = s;
-    exps.push_back( e );
-  }
-  if ( s != hashes.end() ){
-    exps[exps.size()-1].finish = hashes.end();
   }
-  return threads;
 }
 
-void handle_exp( const experiment& exp,
-		 size_t& count,
-		 const set<bitType>& hashSet,
-		 const set<bitType>& confSet,
-		 map<bitType,set<bitType>>& result ){
+void handle_focus( bitType focus,
+		   size_t& count,
+		   const ticcl::bit_array& hashSet,
+		   const ticcl::bit_array& confSet,
+		   vector<diff_pair>& pairs ){
+  // find all anagram values that differ a confusion value from 'focus'
+  // and add them to this thread's pairs
   bitType max = *confSet.rbegin();
-  auto it1 = exp.start;
-  while ( it1 != exp.finish ){
-#pragma omp critical
-    {
-      if ( ++count % 100 == 0 ){
-	cout << ".";
-	cout.flush();
-	if ( count % 5000 == 0 ){
-	  cout << endl << count << endl;;
-	}
-      }
+  const bool follow = !follow_nums.empty();
+  show_progress( count );
+  auto it3 = hashSet.find( focus );
+  if ( it3 == hashSet.end() ){
+    return;
+  }
+  ticcl::bit_array::const_reverse_iterator it2( it3 );
+  while ( it2 != hashSet.rend() ){
+    if ( follow
+	 && follow_nums.find(*it2) != follow_nums.end() ){
+#pragma omp critical(debugout)
+      cerr << "following: " << *it2 << endl;
     }
-    auto it3 = hashSet.find( *it1 );
-    if ( it3 != hashSet.end() ){
-      set<bitType>::const_reverse_iterator it2( it3 );
-      while ( it2 != hashSet.rend() ){
-#pragma omp critical
-	{
-	  if ( follow_nums.find(*it2) != follow_nums.end() ){
-	    cerr << "following: " << *it2 << endl;
-	  }
-	}
-	bitType diff = *it1 - *it2;
-	if ( diff > max ){
-	  break;
-	}
-	if ( confSet.find( diff ) != confSet.end() ){
-#pragma omp critical
-	  {
-	    result[diff].insert(*it2);
-	    if ( follow_nums.find(diff) != follow_nums.end()
-		 || follow_nums.find(*it2) != follow_nums.end() ){
-	      cerr << "stored :" << diff << ":" << *it2 << endl;
-	    }
-	  }
-	}
-	++it2;
-      }
-      // it3 is already set at hashSet.find( *it1 );
-      ++it3;
-      while ( it3 != hashSet.end() ){
-#pragma omp critical
-	{
-	  if ( follow_nums.find(*it1) != follow_nums.end() ){
-	    cerr << "following: " << *it1 << endl;
-	  }
-	}
-	bitType diff = *it3 - *it1;
-	if ( diff > max ){
-	  break;
-	}
-	if ( confSet.find( diff ) != confSet.end() ){
-#pragma omp critical
-	  {
-	    result[diff].insert(*it1);
-	    if ( follow_nums.find(diff) != follow_nums.end()
-		 || follow_nums.find(*it1) != follow_nums.end() ){
-	      cerr << "stored :" << diff << ":" << *it1 << endl;
-	    }
-	  }
-	}
-	++it3;
+    bitType diff = focus - *it2;
+    if ( diff > max ){
+      break;
+    }
+    if ( confSet.find( diff ) != confSet.end() ){
+      pairs.emplace_back( diff, *it2 );
+      if ( follow
+	   && ( follow_nums.find(diff) != follow_nums.end()
+		|| follow_nums.find(*it2) != follow_nums.end() ) ){
+#pragma omp critical(debugout)
+	cerr << "stored :" << diff << ":" << *it2 << endl;
       }
     }
-    ++it1;
+    ++it2;
   }
-}
-
-void output_result( ostream& os,
-		    const map<bitType,set<bitType>>& result ){
-  for ( auto const& [bt,bt_set] : result ){
-    os << bt << "#";
-    for ( const auto& it: bt_set ){
-      os << it;
-      if ( it != *bt_set.rbegin() ){
-	os << ",";
+  // it3 is already set at hashSet.find( focus );
+  ++it3;
+  while ( it3 != hashSet.end() ){
+    if ( follow
+	 && follow_nums.find(focus) != follow_nums.end() ){
+#pragma omp critical(debugout)
+      cerr << "following: " << focus << endl;
+    }
+    bitType diff = *it3 - focus;
+    if ( diff > max ){
+      break;
+    }
+    if ( confSet.find( diff ) != confSet.end() ){
+      pairs.emplace_back( diff, focus );
+      if ( follow
+	   && ( follow_nums.find(diff) != follow_nums.end()
+		|| follow_nums.find(focus) != follow_nums.end() ) ){
+#pragma omp critical(debugout)
+	cerr << "stored :" << diff << ":" << focus << endl;
       }
     }
-    os << endl;
-    os.flush();
+    ++it3;
   }
 }
 
-void output_confusions( ostream& csf,
-			const map<bitType,set<bitType>>& result ){
-  for ( auto const& [bt,bt_set] : result ){
-    csf << bt << "#" << bt_set.size() << endl;
-    csf.flush();
+void handle_focus_window( bitType focus,
+			  size_t& count,
+			  const ticcl::bit_array& hashSet,
+			  const ticcl::confusion_filter& confusions,
+			  vector<diff_pair>& pairs ){
+  // the 'window' engine: the same as handle_focus(), but the anagram
+  // values near 'focus' are scanned in one go by the confusion filter
+  show_progress( count );
+  size_t start = pairs.size();
+  confusions.find_pairs( focus, hashSet, pairs );
+  if ( follow_nums.empty() ){
+    return;
+  }
+  if ( follow_nums.find(focus) != follow_nums.end() ){
+#pragma omp critical(debugout)
+    cerr << "following: " << focus << endl;
+  }
+  for ( size_t i=start; i < pairs.size(); ++i ){
+    if ( follow_nums.find(pairs[i].first) != follow_nums.end()
+	 || follow_nums.find(pairs[i].second) != follow_nums.end() ){
+#pragma omp critical(debugout)
+      cerr << "stored :" << pairs[i].first << ":" << pairs[i].second << endl;
+    }
   }
 }
 
@@ -213,7 +198,8 @@ int main( int argc, char **argv ){
   try {
     opts.add_short_options( "vVho:t:" );
     opts.add_long_options( "charconf:,hash:,low:,high:,foci:,help,"
-			   "version,threads:,confstats:,follow:" );
+			   "version,threads:,confstats:,follow:,grain:,engine:,shard:,"
+			   "binary" );
     opts.init( argc, argv );
   }
   catch( TiCC::OptionError& e ){
@@ -263,10 +249,10 @@ int main( int argc, char **argv ){
   }
 #ifdef HAVE_OPENMP
   if ( TiCC::lowercase(value) == "max" ){
-    num_threads = omp_get_max_threads() - 2;
+    num_threads = max( 1, omp_get_max_threads() - 2 );
   }
   else {
-    if ( !TiCC::stringTo(value,num_threads) ) {
+    if ( !TiCC::stringTo(value,num_threads) || num_threads < 1 ) {
       cerr << "illegal value for -t (" << value << ")" << endl;
       exit( EXIT_FAILURE );
     }
@@ -286,6 +272,32 @@ int main( int argc, char **argv ){
     }
     follow_nums.insert( follow_num );
   }
+  int grain = 1;
+  if ( opts.extract( "grain", value ) ){
+    if ( !TiCC::stringTo(value,grain) || grain < 1 ) {
+      cerr << "illegal value for --grain (" << value << ")" << endl;
+      exit( EXIT_FAILURE );
+    }
+  }
+  size_t shard = 1;
+  size_t shards = 1;
+  if ( opts.extract( "shard", value ) ){
+    if ( !ticcl::parse_shard( value, shard, shards ) ){
+      cerr << "illegal value for --shard (" << value << ")" << endl;
+      exit( EXIT_FAILURE );
+    }
+  }
+  const bool binary = opts.extract( "binary" );
+  bool do_walk = false;
+  if ( opts.extract( "engine", value ) ){
+    if ( value == "walk" ){
+      do_walk = true;
+    }
+    else if ( value != "window" ){
+      cerr << "illegal value for --engine (" << value << ")" << endl;
+      exit( EXIT_FAILURE );
+    }
+  }
   if ( opts.extract("low", value ) ){
     if ( !TiCC::stringTo(value,lowValue) ) {
       cerr << "illegal value for --low (" << value << ")" << endl;
@@ -329,9 +341,21 @@ int main( int argc, char **argv ){
       exit(1);
     }
   }
-  ofstream of( outFile );
-  if ( !of ){
-    cerr << "problem opening output file: " << outFile << endl;
+  ofstream of;
+  unique_ptr<ticcl::index_writer> iw;
+  try {
+    if ( binary ){
+      iw.reset( new ticcl::index_writer( outFile ) );
+    }
+    else {
+      of.open( outFile );
+      if ( !of ){
+	throw runtime_error( outFile );
+      }
+    }
+  }
+  catch ( const exception& e ){
+    cerr << "problem opening output file: " << e.what() << endl;
     exit(1);
   }
 
@@ -347,47 +371,94 @@ int main( int argc, char **argv ){
   }
 
   cout << "reading corpus word anagram hash values" << endl;
-  ifstream cwav( anahashFile );
   size_t skipped = 0;
-  set<bitType> hashSet = ticcl::read_anahash( cwav,
-					      lowValue,
-					      highValue,
-					      skipped,
-					      verbose );
-  cout << "read " << hashSet.size() << " corpus word anagram values" << endl;
-  cout << "skipped " << skipped << " out-of-band corpus word values" << endl;
-
-  ifstream foc( fociFile );
-  set<bitType> focSet = ticcl::read_bit_set( foc );
-  cout << "read " << focSet.size() << " foci values" << endl;
-
-  ifstream conf( confFile );
-  set<bitType> confSet = ticcl::read_confusions( conf );
+  ticcl::bit_array hashSet;
+  ticcl::bit_array focSet;
+  ticcl::bit_array confSet;
+  try {
+    hashSet = ticcl::load_anahash( anahashFile,
+				   lowValue,
+				   highValue,
+				   skipped,
+				   verbose );
+    cout << "read " << hashSet.size() << " corpus word anagram values" << endl;
+    cout << "skipped " << skipped << " out-of-band corpus word values" << endl;
+    focSet = ticcl::load_bit_set( fociFile );
+    cout << "read " << focSet.size() << " foci values" << endl;
+    if ( shards > 1 ){
+      focSet = ticcl::shard_of( focSet, shard, shards );
+      cout << "shard " << shard << "/" << shards << ": "
+	   << focSet.size() << " foci values" << endl;
+    }
+    confSet = ticcl::load_confusions( confFile );
+  }
+  catch ( const exception& e ){
+    cerr << "problem reading input: " << e.what() << endl;
+    exit(1);
+  }
   cout << "read " << confSet.size()
        << " character confusion anagram values" << endl;
 
-  vector<experiment> experiments;
-  size_t expsize = init( experiments, focSet, num_threads );
-
-  cout << "created " << expsize << " separate experiments" << endl;
-
 #ifdef HAVE_OPENMP
-  omp_set_num_threads( expsize );
-  cout << "running on " << expsize << " threads." << endl;
+  omp_set_num_threads( num_threads );
+  cout << "running on " << num_threads << " threads." << endl;
 #endif
 
+  // the cost per focus value varies a lot, so the threads take
+  // 'grain' values at a time, as long as there are any left
+  const bitType *foci = focSet.begin();
+  const size_t foci_count = focSet.size();
+  ticcl::thread_load load( num_threads );
+  // every thread collects its own ( confusion, value ) pairs, these are
+  // merged when all foci are done
   size_t count = 0;
-  map<bitType,set<bitType> > result;
-#pragma omp parallel for shared( experiments, count, result )
-  for ( size_t i=0; i < expsize; ++i ){
-    handle_exp( experiments[i], count, hashSet, confSet, result );
+  vector<vector<diff_pair>> thread_pairs( num_threads );
+  unique_ptr<ticcl::confusion_filter> filter;
+  if ( !do_walk ){
+    filter.reset( new ticcl::confusion_filter( confSet.begin(),
+					       confSet.end() ) );
+    cout << "using the window engine ("
+	 << ticcl::toString( ticcl::ld_best_kernel() ) << ")" << endl;
+  }
+#pragma omp parallel for schedule(dynamic,grain) shared( count, thread_pairs, load )
+  for ( size_t i=0; i < foci_count; ++i ){
+    double start = ticcl::thread_load::now();
+    int thread = 0;
+#ifdef HAVE_OPENMP
+    thread = omp_get_thread_num();
+#endif
+    if ( filter ){
+      handle_focus_window( foci[i], count, hashSet, *filter,
+			   thread_pairs[thread] );
+    }
+    else {
+      handle_focus( foci[i], count, hashSet, confSet, thread_pairs[thread] );
+    }
+    load.add( ticcl::thread_load::now() - start );
   }
+  cout << endl;
+  load.report( cout );
+  double merge_start = ticcl::thread_load::now();
+  vector<diff_pair> result = ticcl::merge_pairs( thread_pairs );
+  cout << "merged " << result.size() << " pairs in "
+       << ticcl::thread_load::now() - merge_start << "s" << endl;
 
-  output_result( of, result );
+  if ( iw ){
+    try {
+      ticcl::write_index( *iw, result, csf );
+      iw->close();
+    }
+    catch ( const exception& e ){
+      cerr << e.what() << endl;
+      exit(1);
+    }
+  }
+  else {
+    ticcl::write_index( of, result, csf );
+  }
 
   cout << "\nwrote indexes into: " << outFile << endl;
   if ( csf ){
-    output_confusions( *csf, result );
     cout << "wrote confusion statistics into: " << confstats_file << endl;
     csf->close();
     delete csf;
@@ -0,0 +1,160 @@
+/*
+  Copyright (c) 2006 - 2024
+  CLST  - Radboud University
+  ILK   - Tilburg University
+
+  This file is part of ticcltools
+
+  ticcltools is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  ticcltools is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/ticcltools/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+
+*/
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+
+#include "ticcutils/CommandLine.h"
+#include "ticcutils/StringOps.h"
+#include "ticcutils/FileUtils.h"
+#include "ticcl/ticcl_common.h"
+
+#include "config.h"
+
+using namespace	std;
+using ticcl::diff_pair;
+
+void usage( const string& name ){
+  cerr << "usage: " << name << " [options] -o <outputfile> FILE..." << endl;
+  cerr << "\tcombines the .index or .indexNT files of TICCL-indexer or"
+       << endl;
+  cerr << "\tTICCL-indexerNT runs with --shard into one index, sorted on"
+       << endl;
+  cerr << "\tconfusion and anagram value, like a single run makes it." << endl;
+  cerr << "\tThe inputs may be text or binary index files. With one input" << endl;
+  cerr << "\tfile, it converts between the two formats." << endl;
+  cerr << "\t-o <outputfile>\t name of the output file. The extension" << endl;
+  cerr << "\t\t\t will be set to '.index'" << endl;
+  cerr << "\t--confstats=<statsfile>\tcreate a list of confusion statistics"
+       << endl;
+  cerr << "\t--binary\t write a binary index file. (default is text)" << endl;
+  cerr << "\t-V or --version\t show version " << endl;
+  cerr << "\t-h or --help\t this message " << endl;
+}
+
+int main( int argc, char **argv ){
+  TiCC::CL_Options opts;
+  try {
+    opts.add_short_options( "Vho:" );
+    opts.add_long_options( "confstats:,help,version,binary" );
+    opts.init( argc, argv );
+  }
+  catch( TiCC::OptionError& e ){
+    cerr << e.what() << endl;
+    usage( argv[0] );
+    exit( EXIT_FAILURE );
+  }
+  string progname = opts.prog_name();
+  if ( opts.extract('h') || opts.extract("help") ){
+    usage( progname );
+    exit(EXIT_SUCCESS);
+  }
+  if ( opts.extract('V') || opts.extract("version") ){
+    cerr << PACKAGE_STRING << endl;
+    exit(EXIT_SUCCESS);
+  }
+  string out_file;
+  opts.extract( 'o', out_file );
+  string confstats_file;
+  opts.extract( "confstats", confstats_file );
+  const bool binary = opts.extract( "binary" );
+  if ( !opts.empty() ){
+    cerr << "unsupported options : " << opts.toString() << endl;
+    usage(progname);
+    exit(EXIT_FAILURE);
+  }
+  vector<string> fileNames = opts.getMassOpts();
+  if ( fileNames.empty() ){
+    cerr << "no input files" << endl;
+    usage(progname);
+    exit(EXIT_FAILURE);
+  }
+  if ( out_file.empty() ){
+    cerr << "missing -o option" << endl;
+    usage(progname);
+    exit(EXIT_FAILURE);
+  }
+  if ( !TiCC::match_back( out_file, ".index" ) ){
+    out_file += ".index";
+  }
+  vector<vector<diff_pair>> parts;
+  for ( const auto& file_name : fileNames ){
+    if ( file_name == out_file ){
+      cerr << "the output file may not be one of the inputs: "
+	   << file_name << endl;
+      exit(EXIT_FAILURE);
+    }
+    try {
+      parts.push_back( ticcl::load_index( file_name ) );
+    }
+    catch ( const exception& e ){
+      cerr << "problem reading " << file_name << ": " << e.what() << endl;
+      exit(EXIT_FAILURE);
+    }
+    cout << "read " << parts.back().size() << " index pairs from "
+	 << file_name << endl;
+  }
+  vector<diff_pair> result = ticcl::merge_pairs( parts );
+  ofstream *csf = 0;
+  if ( !confstats_file.empty() ){
+    csf = new ofstream( confstats_file );
+    if ( !*csf ){
+      cerr << "problem opening outputfile: " << confstats_file << endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  try {
+    if ( binary ){
+      ticcl::index_writer iw( out_file );
+      ticcl::write_index( iw, result, csf );
+      iw.close();
+    }
+    else {
+      ofstream os( out_file );
+      if ( !os ){
+	throw runtime_error( "unable to open: " + out_file );
+      }
+      ticcl::write_index( os, result, csf );
+    }
+  }
+  catch ( const exception& e ){
+    cerr << "problem writing output file: " << e.what() << endl;
+    exit(EXIT_FAILURE);
+  }
+  cout << "wrote " << result.size() << " index pairs into: " << out_file
+       << endl;
+  if ( csf ){
+    cout << "wrote confusion statistics into: " << confstats_file << endl;
+    csf->close();
+    delete csf;
+  }
+  return EXIT_SUCCESS;
+}
@@ -29,6 +29,7 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
@@ -37,6 +38,7 @@
 #include "ticcutils/StringOps.h"
 #include "ticcutils/XMLtools.h"
 #include "ticcutils/Unicode.h"
+#include "ticcl/ticcl_common.h"
 
 #include "config.h"
 #ifdef HAVE_OPENMP
@@ -48,31 +50,29 @@ using namespace	TiCC;
 
 bool verbose = false;
 
-void create_wf_list( const map<UnicodeString, unsigned int>& wc,
+void create_wf_list( const ticcl::word_map<unsigned int>& wc,
 		     const string& filename, unsigned int total_in, bool doperc ){
   ofstream os( filename );
   if ( !os ){
     cerr << "failed to create outputfile '" << filename << "'" << endl;
     exit(EXIT_FAILURE);
   }
-  map<unsigned int, set<UnicodeString> > wf;
-  for( const auto& cit : wc ){
-    wf[cit.second].insert( cit.first );
-  }
+  // highest frequencies first, equal frequencies alphabetically
+  vector<const ticcl::word_map<unsigned int>::entry*> wf = wc.sorted();
+  stable_sort( wf.begin(), wf.end(),
+	       []( const auto *e1, const auto *e2 ){
+		 return e1->value > e2->value;
+	       } );
   unsigned int sum=0;
   unsigned int types=0;
-  auto wit = wf.rbegin();
-  while ( wit != wf.rend() ){
-    for( const auto& sit : wit->second ){
-      sum += wit->first;
-      os << sit << "\t" << wit->first;
-      if ( doperc ){
-	os << "\t" << sum << "\t" << 100 * double(sum)/total_in;
-      }
-      os << endl;
-      ++types;
+  for ( const auto *e : wf ){
+    sum += e->value;
+    os << e->word() << "\t" << e->value;
+    if ( doperc ){
+      os << "\t" << sum << "\t" << 100 * double(sum)/total_in;
     }
-    ++wit;
+    os << endl;
+    ++types;
   }
 #pragma omp critical
   {
@@ -85,7 +85,7 @@ void create_wf_list( const map<UnicodeString, unsigned int>& wc,
 }
 
 size_t read_words( const string& doc_name,
-		   map<UnicodeString,unsigned int>& wc ){
+		   ticcl::word_map<unsigned int>& wc ){
   size_t word_total = 0;
   ifstream is( doc_name );
   UnicodeString line;
@@ -232,7 +232,7 @@ int main( int argc, const char *argv[] ){
   if ( to_do > 1 ){
     cout << "start processing of " << to_do << " files " << endl;
   }
-  map<UnicodeString,unsigned int> wc;
+  ticcl::word_map<unsigned int> wc;
   unsigned int word_total =0;
 #pragma omp parallel for shared(file_names,word_total,wc)
   for ( size_t fn=0; fn < file_names.size(); ++fn ){
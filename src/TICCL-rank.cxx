@@ -1048,13 +1048,13 @@ int main( int argc, char **argv ){
   int failures = 0;
   ifstream input( inFile );
   streamsize pos = input.tellg();
-  UnicodeString input_line;
-  while ( TiCC::getline( input, input_line ) ){
+  string input_line;
+  vector<string_view> parts;
+  while ( getline( input, input_line ) ){
     if ( verbose ){
       cerr << "bekijk " << input_line << endl;
     }
-    vector<UnicodeString> parts = TiCC::split_at( input_line, "~" );
-    if ( parts.size() != RANK_COUNT ){
+    if ( ticcl::split_view( input_line, '~', parts ) != RANK_COUNT ){
       cerr << "invalid line: " << input_line << endl;
       cerr << "expected " << RANK_COUNT << " ~ separated values." << endl;
       if ( ++failures > 50 ){
@@ -1063,11 +1063,11 @@ int main( int argc, char **argv ){
       }
     }
     else {
-      UnicodeString variant = parts[0];
+      UnicodeString variant = ticcl::view_to_unicode( parts[0] );
       fileIds[variant].insert( pos );
-      bitType char_conf_val = TiCC::stringTo<bitType>(parts[6]);
+      bitType char_conf_val = ticcl::view_to<bitType>(parts[6]);
       ++char_conf_val_counts[char_conf_val];
-      size_t ccf = TiCC::stringTo<size_t>(parts[4]);
+      size_t ccf = ticcl::view_to<size_t>(parts[4]);
       cc_freqs[char_conf_val].push_back(ccf);
       if ( ++count % 10000 == 0 ){
 	cout << ".";
@@ -29,6 +29,7 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
@@ -37,6 +38,7 @@
 #include "ticcutils/StringOps.h"
 #include "ticcutils/XMLtools.h"
 #include "ticcutils/Unicode.h"
+#include "ticcl/ticcl_common.h"
 
 #include "config.h"
 #ifdef HAVE_OPENMP
@@ -48,7 +50,7 @@ using namespace	TiCC;
 
 bool verbose = false;
 
-void create_wf_list( const map<UnicodeString, unsigned int>& wc,
+void create_wf_list( const ticcl::word_map<unsigned int>& wc,
 		     const string& filename, unsigned int totalIn,
 		     unsigned int clip,
 		     bool doperc ){
@@ -58,29 +60,30 @@ void create_wf_list( const map<UnicodeString, unsigned int>& wc,
     cerr << "failed to create outputfile '" << filename << "'" << endl;
     exit(EXIT_FAILURE);
   }
-  map<unsigned int, set<UnicodeString> > fws;
-  for ( const auto& [word,freq] : wc ){
-    if ( freq <= clip ){
-      total -= freq;
+  vector<const ticcl::word_map<unsigned int>::entry*> fws;
+  for ( const auto *e : wc.sorted() ){
+    if ( e->value <= clip ){
+      total -= e->value;
     }
     else {
-      fws[freq].insert( word );
+      fws.push_back( e );
     }
   }
+  // highest frequencies first, equal frequencies alphabetically
+  stable_sort( fws.begin(), fws.end(),
+	       []( const auto *e1, const auto *e2 ){
+		 return e1->value > e2->value;
+	       } );
   unsigned int sum=0;
   unsigned int types=0;
-  auto wit = fws.rbegin();
-  while ( wit != fws.rend() ){
-    for( const auto& sit : wit->second ){
-      sum += wit->first;
-      os << sit << "\t" << wit->first;
-      if ( doperc ){
-	os << "\t" << sum << "\t" << 100 * double(sum)/total;
-      }
-      os << endl;
-      ++types;
+  for ( const auto *e : fws ){
+    sum += e->value;
+    os << e->word() << "\t" << e->value;
+    if ( doperc ){
+      os << "\t" << sum << "\t" << 100 * double(sum)/total;
     }
-    ++wit;
+    os << endl;
+    ++types;
   }
 #pragma omp critical
   {
@@ -111,7 +114,7 @@ bool is_emph( const UnicodeString& data ){
 
 size_t tel( const xmlNode *node, bool lowercase,
 	    size_t ngram, const UnicodeString& sep,
-	    map<UnicodeString, unsigned int>& wc,
+	    ticcl::word_map<unsigned int>& wc,
 	    set<UnicodeString>& emps ){
   vector<UnicodeString> buffer(ngram);
   size_t cnt = 0;
@@ -175,7 +178,7 @@ size_t word_xml_inventory( const string& docName,
 			   bool lowercase,
 			   size_t ngram,
 			   const UnicodeString& sep,
-			   map<UnicodeString,unsigned int>& wc,
+			   ticcl::word_map<unsigned int>& wc,
 			   set<UnicodeString>& emps ){
   xmlDoc *d = 0;
   int cnt = 0;
@@ -198,7 +201,7 @@ size_t word_inventory( const string& docName,
 		       bool lowercase,
 		       size_t ngram,
 		       const UnicodeString& sep,
-		       map<UnicodeString,unsigned int>& wc,
+		       ticcl::word_map<unsigned int>& wc,
 		       set<UnicodeString>& emps,
 		       bool dolines ){
   vector<UnicodeString> buffer(ngram);
@@ -428,7 +431,7 @@ int main( int argc, const char *argv[] ){
   if ( toDo > 1 ){
     cout << "start processing of " << toDo << " files " << endl;
   }
-  map<UnicodeString,unsigned int> wc;
+  ticcl::word_map<unsigned int> wc;
   unsigned int wordTotal =0;
 
   set<UnicodeString> hemp;
@@ -30,6 +30,8 @@
 #include <string>
 #include <set>
 #include <map>
+#include <vector>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
@@ -47,6 +49,32 @@ using namespace icu;
 
 bool verbose = false;
 
+using word_counts = ticcl::word_map<unsigned int>;
+using freq_list = vector<pair<unsigned int,const word_counts::entry*>>;
+
+void write_freq_list( ostream& os, freq_list& fw ){
+  // highest frequencies first, equal frequencies alphabetically
+  sort( fw.begin(), fw.end(),
+	[]( const auto& p1, const auto& p2 ){
+	  if ( p1.first != p2.first ){
+	    return p1.first > p2.first;
+	  }
+	  return *p1.second < *p2.second;
+	} );
+  for ( const auto& [freq,entry] : fw ){
+    os << entry->word() << "\t" << freq << endl;
+  }
+}
+
+void write_freq_list( ostream& os, const word_counts& wc ){
+  freq_list fw;
+  fw.reserve( wc.size() );
+  for ( const auto& entry : wc ){
+    fw.push_back( make_pair( entry.value, &entry ) );
+  }
+  write_freq_list( os, fw );
+}
+
 enum S_Class { UNDEF, UNK, PUNCT, IGNORE, CLEAN };
 ostream& operator<<( ostream& os, const S_Class& cl ){
   switch ( cl ){
@@ -471,7 +499,7 @@ UnicodeString filter_punct( const UnicodeString& us ){
 S_Class classify_n_gram( const vector<UnicodeString>& parts,
 			 UnicodeString& end_pun,
 			 unsigned int& lexclean,
-			 const map<UnicodeString,unsigned int>& decap_clean_words,
+			 const word_counts& decap_clean_words,
 			 const set<UChar>& alphabet ){
   if ( verbose ){
     cerr << "classify a " << parts.size() << "-gram" << endl;
@@ -497,7 +525,7 @@ S_Class classify_n_gram( const vector<UnicodeString>& parts,
     UnicodeString pun;
     UnicodeString us = wrd;
     us.toLower();
-    if ( decap_clean_words.find( us ) != decap_clean_words.end() ){
+    if ( decap_clean_words.contains( us ) ){
       // no need to do a lot of work for already clean words
       ++lexclean;
       if ( verbose ){
@@ -509,7 +537,7 @@ S_Class classify_n_gram( const vector<UnicodeString>& parts,
       cl = classify( wrd, alphabet, pun );
       UnicodeString l_pun = pun;
       l_pun.toLower();
-      if ( decap_clean_words.find( l_pun ) != decap_clean_words.end() ){
+      if ( decap_clean_words.contains( l_pun ) ){
 	// so the depunct word is lexically clean
 	++lexclean;
 	if ( verbose ){
@@ -608,12 +636,12 @@ S_Class classify_n_gram( const vector<UnicodeString>& parts,
 }
 
 void classify_one_entry( const UnicodeString& orig_word, unsigned int freq,
-			 map<UnicodeString,unsigned int>& clean_words,
-			 const map<UnicodeString,unsigned int>& decap_clean_words,
-			 map<UnicodeString,unsigned int>& unk_words,
-			 map<UnicodeString,UnicodeString>& punct_words,
-			 map<UnicodeString,unsigned int>& punct_acro_words,
-			 map<UnicodeString,unsigned int>& compound_acro_words,
+			 word_counts& clean_words,
+			 const word_counts& decap_clean_words,
+			 word_counts& unk_words,
+			 ticcl::word_map<UnicodeString>& punct_words,
+			 word_counts& punct_acro_words,
+			 word_counts& compound_acro_words,
 			 bool doAcro,
 			 const set<UChar>& alphabet,
 			 size_t artifreq ){
@@ -761,9 +789,9 @@ void format( const UnicodeString& line ){
   }
 }
 
-map<UnicodeString,unsigned int> read_back_lex( istream& is,
-					       size_t artifreq ){
-  map<UnicodeString,unsigned int> result;
+word_counts read_back_lex( istream& is,
+			   size_t artifreq ){
+  word_counts result;
   UnicodeString line;
   while ( TiCC::getline( is, line ) ){
     vector<UnicodeString> v = TiCC::split_at( line, "\t" );
@@ -793,8 +821,8 @@ map<UnicodeString,unsigned int> read_back_lex( istream& is,
   return result;
 }
 
-map<UnicodeString,unsigned> read_fore_lex( istream& is ){
-  map<UnicodeString,unsigned> result;
+word_counts read_fore_lex( istream& is ){
+  word_counts result;
   size_t err_cnt = 0;
   size_t line_cnt = 0 ;
   UnicodeString line;
@@ -1016,14 +1044,14 @@ int main( int argc, const char *argv[] ){
     cout << "reading Historical Emphases: " << hemp_file << endl;
     fillHemps( hs, hemps );
   }
-  map<UnicodeString,unsigned int> all_clean_words;
-  map<UnicodeString,unsigned int> fore_clean_words;
-  map<UnicodeString,unsigned int> decap_clean_words;
-  map<UnicodeString,unsigned int> unk_words;
-  map<UnicodeString,unsigned int> punct_acro_words;
-  map<UnicodeString,unsigned int> compound_acro_words;
-  map<UnicodeString,UnicodeString> punct_words;
-  map<UnicodeString,unsigned int> back_lexicon;
+  word_counts all_clean_words;
+  word_counts fore_clean_words;
+  word_counts decap_clean_words;
+  word_counts unk_words;
+  word_counts punct_acro_words;
+  word_counts compound_acro_words;
+  ticcl::word_map<UnicodeString> punct_words;
+  word_counts back_lexicon;
   //  hemps.insert("F_1_o_r_e_n_t_ij_n_e_r.");
   if ( !hemps.empty() ){
     cout << "start classifying the Historical Emphases with "
@@ -1034,7 +1062,7 @@ int main( int argc, const char *argv[] ){
       for ( const auto& u : uparts ){
 	clean += u;
       }
-      map<UnicodeString,UnicodeString> dummy_puncts;
+      ticcl::word_map<UnicodeString> dummy_puncts;
       classify_one_entry( clean, 1,
 			  fore_clean_words, decap_clean_words,
 			  unk_words, dummy_puncts,
@@ -1065,18 +1093,19 @@ int main( int argc, const char *argv[] ){
     cout << "read a background lexicon with " << back_lexicon.size()
 	 << " entries." << endl;
 
-    for ( const auto& [word,freq] : back_lexicon ){
-      UnicodeString w = word;
-      all_clean_words[w] += freq;
+    for ( const auto& entry : back_lexicon ){
+      UnicodeString w = entry.word();
+      all_clean_words[w] += entry.value;
       w.toLower();
-      decap_clean_words[w] += freq;
+      decap_clean_words[w] += entry.value;
     }
   }
-  map<UnicodeString,unsigned> fore_lexicon = read_fore_lex( is );
+  word_counts fore_lexicon = read_fore_lex( is );
   cout << "start classifying the foreground lexicon with "
        << fore_lexicon.size() << " entries"<< endl;
-  for ( const auto& [word,freq] : fore_lexicon ){
-    classify_one_entry( word, freq,
+  for ( const auto *entry : fore_lexicon.sorted() ){
+    // in alphabetical order. The order matters for the artifreq logic
+    classify_one_entry( entry->word(), entry->value,
 			fore_clean_words, decap_clean_words,
 			unk_words, punct_words,
 			punct_acro_words, compound_acro_words,
@@ -1086,81 +1115,47 @@ int main( int argc, const char *argv[] ){
   cout << "using artifrq=" << artifreq << endl;
   if ( !background_file.empty() ){
     ofstream fcs( fore_clean_file_name );
-    map<unsigned int, set<UnicodeString> > fw;
-    for ( const auto& [word,f] : fore_clean_words ){
-      unsigned int freq = f;
-      auto back_it = back_lexicon.find( word );
-      if ( back_it != back_lexicon.end() ){
+    freq_list fw;
+    for ( const auto& entry : fore_clean_words ){
+      unsigned int freq = entry.value;
+      const unsigned int *back_freq = back_lexicon.find( entry.word() );
+      if ( back_freq ){
 	// add background frequency to the foreground
-	freq += back_it->second;
+	freq += *back_freq;
       }
       if ( freq > artifreq && (freq -  artifreq) > artifreq ){
       	freq -= artifreq;
       }
-      fw[freq].insert( word );
-    }
-    auto wit = fw.rbegin();
-    while ( wit != fw.rend() ){
-      for ( const auto& sit : wit->second ){
-	fcs << sit << "\t" << wit->first << endl;
-      }
-      ++wit;
+      fw.push_back( make_pair( freq, &entry ) );
     }
+    write_freq_list( fcs, fw );
     cout << "created separate " << fore_clean_file_name << endl;
-    for ( auto& [word,freq] : fore_clean_words ){
+    for ( auto& entry : fore_clean_words ){
+      UnicodeString word = entry.word();
       unsigned int f1 = all_clean_words[word];
-      if ( freq > artifreq && f1 >= artifreq ){
-	freq -= artifreq;
+      if ( entry.value > artifreq && f1 >= artifreq ){
+	entry.value -= artifreq;
       }
-      all_clean_words[word] += freq;
-    }
-    fw.clear();
-    for ( const auto& [word,freq] : all_clean_words ){
-      fw[freq].insert( word );
-    }
-    wit = fw.rbegin();
-    while ( wit != fw.rend() ){
-      for ( const auto& sit : wit->second ){
-	acs << sit << "\t" << wit->first << endl;
-      }
-      ++wit;
+      all_clean_words[word] += entry.value;
     }
+    write_freq_list( acs, all_clean_words );
     cout << "created " << all_clean_file_name << endl;
   }
   else {
-    map<unsigned int, set<UnicodeString> > fw;
-    for ( const auto& [word,freq] : fore_clean_words ){
-      fw[freq].insert( word );
-    }
-    auto wit = fw.rbegin();
-    while ( wit != fw.rend() ){
-      for ( const auto& sit : wit->second ){
-	acs << sit << "\t" << wit->first << endl;
-      }
-      ++wit;
-    }
+    write_freq_list( acs, fore_clean_words );
     cout << "created " << all_clean_file_name << endl;
   }
-  map<unsigned int, set<UnicodeString> > fw_out;
-  for ( const auto& [word,freq] : unk_words ){
-    fw_out[freq].insert( word );
-  }
-  auto wit = fw_out.rbegin();
-  while ( wit != fw_out.rend() ){
-    for ( const auto& sit : wit->second ){
-      unk_s << sit << "\t" << wit->first << endl;
-    }
-    ++wit;
-  }
+  write_freq_list( unk_s, unk_words );
   cout << "created " << unk_file_name << endl;
 
   if ( doAcro ){
-    for ( const auto& [ps,acro] : punct_acro_words ){
+    for ( const auto *entry : punct_acro_words.sorted() ){
+      UnicodeString ps = entry->word();
       UnicodeString us = filter_punct( ps );
-      if ( compound_acro_words.find( us ) != compound_acro_words.end() ){
+      if ( compound_acro_words.contains( us ) ){
 	// the 'dotted' word is a true acronym
 	// add to the list
-	compound_acro_words[ps] += acro;
+	compound_acro_words[ps] += entry->value;
       }
       else {
 	// mishit: add to the punct file??
@@ -1169,13 +1164,13 @@ int main( int argc, const char *argv[] ){
       }
     }
     ofstream as( acro_file_name );
-    for ( const auto& [ps,ac] : compound_acro_words ){
-      as << ps << "\t" << ac << endl;
+    for ( const auto *entry : compound_acro_words.sorted() ){
+      as << entry->word() << "\t" << entry->value << endl;
     }
     cout << "created " << acro_file_name << endl;
   }
-  for ( const auto& [punc,word] : punct_words ){
-    punct_s << punc << "\t" << word << endl;
+  for ( const auto *entry : punct_words.sorted() ){
+    punct_s << entry->word() << "\t" << entry->value << endl;
   }
   cout << "created " << punct_file_name << endl;
   cout << "done!" << endl;
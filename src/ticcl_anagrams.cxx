@@ -0,0 +1,208 @@
+/*
+  Copyright (c) 2006 - 2024
+  CLST  - Radboud University
+  ILK   - Tilburg University
+
+  This file is part of ticcltools
+
+  ticcltools is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  ticcltools is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/ticcltools/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+*/
+
+
+// the binary anagram word index: the words of every anagram value, as in an
+// .anahash file, to be memory mapped instead of parsed.
+// (see anagram_file_header)
+
+#include "ticcl/ticcl_common.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace ticcl {
+
+  static const char anagram_magic[8] = { 'T','I','C','C','L','A','W','1' };
+
+  anagram_writer::anagram_writer( const string& file_name ):
+    _name( file_name ),
+    _pos( sizeof(anagram_file_header) )
+  {
+    _os.reset( new ofstream( file_name, ios::binary | ios::trunc ) );
+    anagram_file_header h;
+    memset( &h, 0, sizeof(h) );
+    memcpy( h.magic, anagram_magic, sizeof(anagram_magic) );
+    _os->write( reinterpret_cast<const char*>(&h), sizeof(h) );
+    if ( !*_os ){
+      throw runtime_error( "unable to write anagram index: " + file_name );
+    }
+  }
+
+  anagram_writer::~anagram_writer(){
+    // without a close() the file stays unfinished
+  }
+
+  void anagram_writer::add_key( bitType key ){
+    if ( !_keys.empty() && key <= _keys.back() ){
+      throw runtime_error( "anagram index " + _name
+			   + ": anagram values out of order" );
+    }
+    _keys.push_back( key );
+    _first.push_back( _offsets.size() );
+  }
+
+  void anagram_writer::add_word( string_view word ){
+    if ( _keys.empty() ){
+      throw runtime_error( "anagram index " + _name
+			   + ": a word without an anagram value" );
+    }
+    _os->write( word.data(), word.size() );
+    _offsets.push_back( _pos );
+    _pos += word.size();
+  }
+
+  void anagram_writer::close(){
+    _first.push_back( _offsets.size() );
+    _offsets.push_back( _pos );
+    const size_t pad = ( 8 - _pos % 8 ) % 8;
+    const char zeros[8] = { 0 };
+    _os->write( zeros, pad );
+    anagram_file_header h;
+    memset( &h, 0, sizeof(h) );
+    memcpy( h.magic, anagram_magic, sizeof(anagram_magic) );
+    h.keys = _keys.size();
+    h.words = _offsets.size() - 1;
+    h.table = _pos + pad;
+    for ( const auto *table : { &_keys, &_first, &_offsets } ){
+      _os->write( reinterpret_cast<const char*>(table->data()),
+		  table->size() * sizeof(uint64_t) );
+    }
+    _os->seekp( 0 );
+    _os->write( reinterpret_cast<const char*>(&h), sizeof(h) );
+    _os->close();
+    if ( !*_os ){
+      throw runtime_error( "problem writing anagram index: " + _name );
+    }
+  }
+
+  anagram_index::anagram_index( const string& file_name ):
+    _data(0),
+    _keys(0),
+    _first(0),
+    _offsets(0),
+    _map(0),
+    _map_size(0)
+  {
+    int fd = open( file_name.c_str(), O_RDONLY );
+    if ( fd < 0 ){
+      throw runtime_error( "unable to open anagram index: " + file_name );
+    }
+    struct stat st;
+    if ( fstat( fd, &st ) != 0
+	 || size_t(st.st_size) < sizeof(anagram_file_header) ){
+      close( fd );
+      throw runtime_error( "not an anagram index: " + file_name );
+    }
+    _map = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( _map == MAP_FAILED ){
+      _map = 0;
+      throw runtime_error( "unable to mmap anagram index: " + file_name );
+    }
+    _map_size = st.st_size;
+    memcpy( &_header, _map, sizeof(anagram_file_header) );
+    if ( memcmp( _header.magic, anagram_magic, sizeof(anagram_magic) ) != 0 ){
+      munmap( _map, _map_size );
+      throw runtime_error( "not an anagram index: " + file_name );
+    }
+    _data = static_cast<const char*>(_map);
+    _keys = reinterpret_cast<const uint64_t*>( _data + _header.table );
+    _first = _keys + _header.keys;
+    _offsets = _first + _header.keys + 1;
+    if ( _header.table == 0
+	 || _header.table % 8 != 0
+	 || _header.table + ( 2*_header.keys + _header.words + 2 )
+	 * sizeof(uint64_t) != _map_size
+	 || _first[_header.keys] != _header.words
+	 || _offsets[_header.words] > _header.table ){
+      munmap( _map, _map_size );
+      throw runtime_error( "unfinished or corrupt anagram index: "
+			   + file_name );
+    }
+  }
+
+  anagram_index::~anagram_index(){
+    if ( _map ){
+      munmap( _map, _map_size );
+    }
+  }
+
+  size_t anagram_index::find( bitType key ) const {
+    const uint64_t *end = _keys + _header.keys;
+    const uint64_t *it = lower_bound( _keys, end, key );
+    if ( it == end || *it != key ){
+      return _header.keys;
+    }
+    return it - _keys;
+  }
+
+  bool is_anagram_index( const string& file_name ){
+    ifstream is( file_name, ios::binary );
+    char magic[sizeof(anagram_magic)];
+    if ( !is.read( magic, sizeof(magic) ) ){
+      return false;
+    }
+    return memcmp( magic, anagram_magic, sizeof(anagram_magic) ) == 0;
+  }
+
+  size_t write_anagram_index( const string& in_name,
+			      const string& out_name ){
+    ifstream is( in_name );
+    if ( !is ){
+      throw runtime_error( "unable to open: " + in_name );
+    }
+    anagram_writer aw( out_name );
+    size_t keys = 0;
+    string line;
+    vector<string_view> parts;
+    vector<string_view> words;
+    while ( getline( is, line ) ){
+      if ( split_view( line, '~', parts ) != 2 ){
+	// the empty last line
+	continue;
+      }
+      aw.add_key( view_to<bitType>( parts[0] ) );
+      split_view( parts[1], '#', words );
+      for ( const auto& word : words ){
+	aw.add_word( word );
+      }
+      ++keys;
+    }
+    aw.close();
+    return keys;
+  }
+
+} // namespace ticcl
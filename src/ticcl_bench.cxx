@@ -0,0 +1,246 @@
+/*
+  Copyright (c) 2006 - 2024
+  CLST  - Radboud University
+  ILK   - Tilburg University
+
+  This file is part of ticcltools
+
+  ticcltools is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  ticcltools is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/ticcltools/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+*/
+
+// micro benchmarks for the libticcl kernels. (built with 'make check')
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include "ticcutils/StringOps.h"
+#include "ticcutils/Unicode.h"
+#include "ticcl/ticcl_common.h"
+
+using namespace std;
+using namespace icu;
+
+void usage( const string& name ){
+  cerr << "usage: " << name << " ld <wordlist> [window]" << endl;
+  cerr << "\tcompare every word in 'wordlist' (first column) with the next"
+       << endl;
+  cerr << "\t'window' words in sorted order (default 50), using the classic"
+       << endl;
+  cerr << "\tDP Levenshtein, the default ticcl::ldCompare() and" << endl;
+  cerr << "\tticcl::ldWithin() with k=2. Then the same for all the" << endl;
+  cerr << "\tticcl::ldCompareMany() kernels that this CPU supports" << endl;
+  cerr << "   or: " << name << " hash <alphabet> <wordlist>" << endl;
+  cerr << "\thash every word in 'wordlist' (first column) using the map"
+       << endl;
+  cerr << "\tbased ticcl::hash() and the ticcl::alphabet_table version"
+       << endl;
+}
+
+vector<UnicodeString> read_words( const string& file_name,
+				  bool sorted = true ){
+  ifstream is( file_name );
+  if ( !is ){
+    cerr << "unable to open: " << file_name << endl;
+    exit( EXIT_FAILURE );
+  }
+  vector<UnicodeString> result;
+  UnicodeString line;
+  while ( TiCC::getline( is, line ) ){
+    vector<UnicodeString> parts = TiCC::split_at( line, "\t" );
+    if ( parts.empty() ){
+      continue;
+    }
+    UnicodeString word = parts[0];
+    if ( !sorted ){
+      result.push_back( word );
+      continue;
+    }
+    word.toLower();
+    result.push_back( word );
+  }
+  if ( !sorted ){
+    return result;
+  }
+  sort( result.begin(), result.end() );
+  result.erase( unique( result.begin(), result.end() ), result.end() );
+  return result;
+}
+
+template <typename F>
+double time_ld( const vector<UnicodeString>& words,
+		size_t window,
+		F ld,
+		size_t& pairs,
+		size_t& sum ){
+  auto start = chrono::steady_clock::now();
+  pairs = 0;
+  sum = 0;
+  for ( size_t i=0; i < words.size(); ++i ){
+    for ( size_t j=i+1; j < words.size() && j <= i+window; ++j ){
+      sum += ld( words[i], words[j] );
+      ++pairs;
+    }
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+double time_many( const vector<UnicodeString>& words,
+		  size_t window,
+		  ticcl::ld_kernel kernel,
+		  size_t& sum ){
+  auto start = chrono::steady_clock::now();
+  sum = 0;
+  vector<unsigned int> lds( window );
+  for ( size_t i=0; i < words.size(); ++i ){
+    size_t n = min( window, words.size() - i - 1 );
+    ticcl::ldCompareMany( words[i], words.data() + i + 1, n,
+			  lds.data(), kernel );
+    for ( size_t j=0; j < n; ++j ){
+      sum += lds[j];
+    }
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int bench_ld( const string& file_name, size_t window ){
+  vector<UnicodeString> words = read_words( file_name );
+  cout << "read " << words.size() << " unique words from "
+       << file_name << endl;
+  size_t pairs = 0;
+  size_t sum_dp = 0;
+  size_t sum_bp = 0;
+  double t_dp = time_ld( words, window, ticcl::ldCompareDP, pairs, sum_dp );
+  double t_bp = time_ld( words, window, ticcl::ldCompare, pairs, sum_bp );
+  const unsigned int k = 2;
+  size_t sum_within = 0;
+  auto within = []( const UnicodeString& s1, const UnicodeString& s2 ){
+    return ticcl::ldWithin( s1, s2, k );
+  };
+  double t_within = time_ld( words, window, within, pairs, sum_within );
+  size_t mismatch = 0;
+  for ( size_t i=0; i < words.size(); ++i ){
+    for ( size_t j=i+1; j < words.size() && j <= i+window; ++j ){
+      unsigned int ld = ticcl::ldCompareDP( words[i], words[j] );
+      if ( ticcl::ldCompare( words[i], words[j] ) != ld
+	   || ticcl::ldWithin( words[i], words[j], k ) != min( ld, k+1 ) ){
+	++mismatch;
+      }
+    }
+  }
+  cout << pairs << " pairs" << endl;
+  cout << "classic DP    : " << t_dp << " s  ("
+       << pairs / t_dp / 1e6 << " Mpairs/s)" << endl;
+  cout << "bit-parallel  : " << t_bp << " s  ("
+       << pairs / t_bp / 1e6 << " Mpairs/s)" << endl;
+  cout << "speedup       : " << t_dp / t_bp << endl;
+  cout << "ldWithin(" << k << ")   : " << t_within << " s  ("
+       << pairs / t_within / 1e6 << " Mpairs/s)" << endl;
+  cout << "speedup       : " << t_dp / t_within << endl;
+  for ( const auto kernel : { ticcl::ld_kernel::SCALAR,
+			      ticcl::ld_kernel::SSE4,
+			      ticcl::ld_kernel::AVX2 } ){
+    if ( kernel > ticcl::ld_best_kernel() ){
+      break;
+    }
+    size_t sum_many = 0;
+    double t_many = time_many( words, window, kernel, sum_many );
+    string name = "many " + ticcl::toString( kernel );
+    name.resize( 14, ' ' );
+    cout << name << ": " << t_many << " s  ("
+	 << pairs / t_many / 1e6 << " Mpairs/s)" << endl;
+    cout << "speedup       : " << t_dp / t_many << endl;
+    if ( sum_many != sum_dp ){
+      ++mismatch;
+    }
+  }
+  if ( mismatch > 0 || sum_dp != sum_bp ){
+    cerr << "FAILED: " << mismatch << " different distances" << endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+template <typename A>
+double time_hash( const vector<UnicodeString>& words,
+		  const A& alphabet,
+		  vector<ticcl::bitType>& hashes ){
+  auto start = chrono::steady_clock::now();
+  hashes.clear();
+  hashes.reserve( words.size() );
+  for ( const auto& word : words ){
+    hashes.push_back( ticcl::hash( word, alphabet ) );
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int bench_hash( const string& alpha_name, const string& file_name ){
+  ifstream as( alpha_name );
+  if ( !as ){
+    cerr << "unable to open: " << alpha_name << endl;
+    return EXIT_FAILURE;
+  }
+  map<UChar,ticcl::bitType> chars;
+  ticcl::fillAlphabet( as, chars );
+  ticcl::alphabet_table table( chars );
+  vector<UnicodeString> words = read_words( file_name, false );
+  cout << "read " << words.size() << " words from " << file_name << endl;
+  vector<ticcl::bitType> h_map;
+  vector<ticcl::bitType> h_table;
+  double t_map = time_hash( words, chars, h_map );
+  double t_table = time_hash( words, table, h_table );
+  cout << "map           : " << t_map << " s  ("
+       << words.size() / t_map / 1e6 << " Mwords/s)" << endl;
+  cout << "alphabet_table: " << t_table << " s  ("
+       << words.size() / t_table / 1e6 << " Mwords/s)" << endl;
+  cout << "speedup       : " << t_map / t_table << endl;
+  if ( h_map != h_table ){
+    cerr << "FAILED: different hash values" << endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+int main( int argc, char *argv[] ){
+  if ( argc < 3 ){
+    usage( argv[0] );
+    return EXIT_FAILURE;
+  }
+  string mode = argv[1];
+  if ( mode == "ld" ){
+    size_t window = 50;
+    if ( argc > 3 && !TiCC::stringTo( string(argv[3]), window ) ){
+      cerr << "illegal value for window (" << argv[3] << ")" << endl;
+      return EXIT_FAILURE;
+    }
+    return bench_ld( argv[2], window );
+  }
+  if ( mode == "hash" && argc > 3 ){
+    return bench_hash( argv[2], argv[3] );
+  }
+  usage( argv[0] );
+  return EXIT_FAILURE;
+}
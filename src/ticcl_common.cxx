@@ -29,8 +29,21 @@
 #include "ticcl/ticcl_common.h"
 
 #include <cstdlib>
+#include <cstring>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "config.h"
+#ifdef HAVE_OPENMP
+#include "omp.h"
+#endif
 
 using namespace icu;
 using namespace std;
@@ -91,7 +104,107 @@ namespace ticcl {
     return result;
   }
 
-  unsigned int ldCompare( const UnicodeString& s1, const UnicodeString& s2 ){
+  void alphabet_table::fill( const map<UChar,bitType>& alphabet ){
+    _chars = alphabet;
+    _values.assign( 0x10000, 0 );
+    _info.assign( 0x10000, 0 );
+    for ( UChar32 c=0; c < 0x10000; ++c ){
+      uint8_t kind;
+      auto it = alphabet.find( c );
+      if ( it != alphabet.end() ){
+	kind = CHAR;
+	_values[c] = it->second;
+      }
+      else if ( u_isspace( c ) ){
+	kind = SPACE;
+      }
+      else if ( ispunct( (int8_t)u_charType( c ) ) ){
+	kind = PUNCT;
+      }
+      else {
+	kind = UNK;
+      }
+      if ( !U16_IS_SURROGATE( c ) && u_tolower( c ) == c ){
+	// surrogates are excluded, the code point might have a lowercase
+	kind |= STABLE;
+      }
+      _info[c] = kind;
+    }
+  }
+
+  bitType hash( const UnicodeString& s,
+		const alphabet_table& alphabet,
+		bool debug ){
+    const UnicodeString *sp = &s;
+    UnicodeString us;
+    for ( int i=0; i < s.length(); ++i ){
+      if ( !alphabet.lower_stable( s[i] ) ){
+	// only lowercase a copy when needed
+	us = s;
+	us.toLower();
+	sp = &us;
+	break;
+      }
+    }
+    const UnicodeString& ls = *sp;
+    bitType result = 0;
+    bool multPunct = false;
+    for( int i=0; i < ls.length(); ++i ){
+      const UChar uc = ls[i];
+      switch ( alphabet.kind( uc ) ){
+      case alphabet_table::CHAR:
+	result += alphabet.value( uc );
+	if ( debug ){
+	  cerr << "  CHAR, add " << UnicodeString( uc ) << " "
+	       << alphabet.value( uc ) << " ==> " << result << endl;
+	}
+	break;
+      case alphabet_table::SPACE:
+	break;
+      case alphabet_table::PUNCT:
+	if ( !multPunct ){
+	  result += HonderdHash;
+	  if ( debug ){
+	    cerr << "PUNCT, add " << UnicodeString( uc ) << " "
+		 << HonderdHash	 << " ==> " << result << endl;
+	  }
+	  multPunct = true;
+	}
+	break;
+      case alphabet_table::UNK:
+	result += HonderdEenHash;
+	if ( debug ){
+	  cerr << "   UNK, add " << UnicodeString( uc ) << " "
+	       << HonderdHash << " ==> " << result << endl;
+	}
+	break;
+      }
+    }
+    return result;
+  }
+
+  void hash_batch( const vector<UnicodeString>& words,
+		   const alphabet_table& alphabet,
+		   vector<bitType>& result,
+		   int threads ){
+    result.resize( words.size() );
+    const long int size = words.size();
+#ifdef HAVE_OPENMP
+    if ( threads <= 0 ){
+      threads = omp_get_max_threads();
+    }
+#else
+    (void)threads;
+#endif
+#pragma omp parallel for schedule(static) num_threads(threads) if(size > 1000)
+    for ( long int i=0; i < size; ++i ){
+      result[i] = hash( words[i], alphabet );
+    }
+  }
+
+  unsigned int ldCompareDP( const UnicodeString& s1,
+			    const UnicodeString& s2 ){
+    // the classic dynamic programming algorithm. O(n*m)
     const size_t len1 = s1.length(), len2 = s2.length();
     vector<unsigned int> col(len2+1), prevCol(len2+1);
     for ( unsigned int i = 0; i < prevCol.size(); ++i ){
@@ -108,6 +221,269 @@ namespace ticcl {
     return result;
   }
 
+  static unsigned int myers_64( const UChar *pat, int m,
+				const UChar *txt, int n ){
+    // Myers/Hyyrö bit-parallel Levenshtein distance, for 0 < m <= 64
+    // every column of the DP matrix is encoded in 2 bitvectors (Pv and Mv)
+    // holding the positive and negative vertical deltas.
+    // code units < 256 use a direct lookup table for the pattern bitmasks,
+    // the rest lives in a (short) list.
+    // the table is kept per thread, and cleared again on exit, which is
+    // much cheaper than zeroing it on every call
+    static thread_local uint64_t low_peq[256] = {0};
+    UChar high_char[64];
+    uint64_t high_peq[64];
+    int high_cnt = 0;
+    for ( int i=0; i < m; ++i ){
+      const uint64_t bit = uint64_t(1) << i;
+      if ( pat[i] < 256 ){
+	low_peq[pat[i]] |= bit;
+      }
+      else {
+	int k = 0;
+	while ( k < high_cnt && high_char[k] != pat[i] ){
+	  ++k;
+	}
+	if ( k == high_cnt ){
+	  high_char[high_cnt] = pat[i];
+	  high_peq[high_cnt++] = 0;
+	}
+	high_peq[k] |= bit;
+      }
+    }
+    uint64_t Pv = ~uint64_t(0);
+    uint64_t Mv = 0;
+    const uint64_t last = uint64_t(1) << (m-1);
+    unsigned int score = m;
+    for ( int j=0; j < n; ++j ){
+      uint64_t Eq = 0;
+      if ( txt[j] < 256 ){
+	Eq = low_peq[txt[j]];
+      }
+      else {
+	for ( int k=0; k < high_cnt; ++k ){
+	  if ( high_char[k] == txt[j] ){
+	    Eq = high_peq[k];
+	    break;
+	  }
+	}
+      }
+      const uint64_t Xv = Eq | Mv;
+      const uint64_t Xh = (((Eq & Pv) + Pv) ^ Pv) | Eq;
+      uint64_t Ph = Mv | ~(Xh | Pv);
+      uint64_t Mh = Pv & Xh;
+      if ( Ph & last ){
+	++score;
+      }
+      else if ( Mh & last ){
+	--score;
+      }
+      Ph = (Ph << 1) | 1;
+      Mh <<= 1;
+      Pv = Mh | ~(Xv | Ph);
+      Mv = Ph & Xv;
+    }
+    for ( int i=0; i < m; ++i ){
+      if ( pat[i] < 256 ){
+	low_peq[pat[i]] = 0;
+      }
+    }
+    return score;
+  }
+
+  static unsigned int myers_blocks( const UChar *pat, int m,
+				    const UChar *txt, int n ){
+    // the multi-word version of myers_64(), for patterns of any length.
+    // the horizontal delta at the bottom of every 64 bit block is carried
+    // into the next block.
+    const int words = (m+63) / 64;
+    vector<uint64_t> low_peq( 256*words, 0 );
+    vector<UChar> high_char;
+    vector<uint64_t> high_peq;
+    for ( int i=0; i < m; ++i ){
+      const uint64_t bit = uint64_t(1) << (i % 64);
+      if ( pat[i] < 256 ){
+	low_peq[pat[i]*words + i/64] |= bit;
+      }
+      else {
+	size_t k = 0;
+	while ( k < high_char.size() && high_char[k] != pat[i] ){
+	  ++k;
+	}
+	if ( k == high_char.size() ){
+	  high_char.push_back( pat[i] );
+	  high_peq.resize( high_peq.size() + words, 0 );
+	}
+	high_peq[k*words + i/64] |= bit;
+      }
+    }
+    const vector<uint64_t> no_peq( words, 0 );
+    vector<uint64_t> Pv( words, ~uint64_t(0) );
+    vector<uint64_t> Mv( words, 0 );
+    const uint64_t top = uint64_t(1) << 63;
+    const uint64_t last = uint64_t(1) << ((m-1) % 64);
+    unsigned int score = m;
+    for ( int j=0; j < n; ++j ){
+      const uint64_t *peq = no_peq.data();
+      if ( txt[j] < 256 ){
+	peq = &low_peq[txt[j]*words];
+      }
+      else {
+	for ( size_t k=0; k < high_char.size(); ++k ){
+	  if ( high_char[k] == txt[j] ){
+	    peq = &high_peq[k*words];
+	    break;
+	  }
+	}
+      }
+      int hin = 1; // the top row of the DP matrix increases by 1
+      for ( int w=0; w < words; ++w ){
+	uint64_t Eq = peq[w];
+	const uint64_t pv = Pv[w];
+	const uint64_t mv = Mv[w];
+	const uint64_t Xv = Eq | mv;
+	if ( hin < 0 ){
+	  Eq |= 1;
+	}
+	const uint64_t Xh = (((Eq & pv) + pv) ^ pv) | Eq;
+	uint64_t Ph = mv | ~(Xh | pv);
+	uint64_t Mh = pv & Xh;
+	const uint64_t high_bit = ( w == words-1 ) ? last : top;
+	int hout = 0;
+	if ( Ph & high_bit ){
+	  hout = 1;
+	}
+	else if ( Mh & high_bit ){
+	  hout = -1;
+	}
+	Ph <<= 1;
+	Mh <<= 1;
+	if ( hin < 0 ){
+	  Mh |= 1;
+	}
+	else if ( hin > 0 ){
+	  Ph |= 1;
+	}
+	Pv[w] = Mh | ~(Xv | Ph);
+	Mv[w] = Ph & Xv;
+	hin = hout;
+      }
+      score += hin;
+    }
+    return score;
+  }
+
+  static void strip_common( const UChar *& p1, int& len1,
+			    const UChar *& p2, int& len2 ){
+    // a common prefix or suffix doesn't add to the distance
+    while ( len1 > 0 && len2 > 0 && *p1 == *p2 ){
+      ++p1;
+      ++p2;
+      --len1;
+      --len2;
+    }
+    while ( len1 > 0 && len2 > 0 && p1[len1-1] == p2[len2-1] ){
+      --len1;
+      --len2;
+    }
+  }
+
+  unsigned int ldCompare( const UnicodeString& s1, const UnicodeString& s2 ){
+    // bit-parallel Levenshtein distance on UTF-16 code units.
+    // gives the same results as ldCompareDP()
+    const UChar *p1 = s1.getBuffer();
+    const UChar *p2 = s2.getBuffer();
+    int len1 = s1.length();
+    int len2 = s2.length();
+    strip_common( p1, len1, p2, len2 );
+    if ( len1 == 0 ){
+      return len2;
+    }
+    if ( len2 == 0 ){
+      return len1;
+    }
+    // the shortest string is used as the pattern
+    if ( len1 > len2 ){
+      swap( p1, p2 );
+      swap( len1, len2 );
+    }
+    if ( len1 <= 64 ){
+      return myers_64( p1, len1, p2, len2 );
+    }
+    return myers_blocks( p1, len1, p2, len2 );
+  }
+
+  unsigned int ldWithin( const UnicodeString& s1,
+			 const UnicodeString& s2,
+			 unsigned int k ){
+    // returns the Levenshtein distance between s1 and s2 when it is at most
+    // k, and k+1 otherwise.
+    // only the diagonal band |i-j| <= k of the DP matrix is computed
+    // (Ukkonen), and we bail out as soon as a whole row exceeds k
+    const unsigned int too_far = k+1;
+    const UChar *p1 = s1.getBuffer();
+    const UChar *p2 = s2.getBuffer();
+    int len1 = s1.length();
+    int len2 = s2.length();
+    if ( (unsigned int)abs( len1 - len2 ) > k ){
+      return too_far;
+    }
+    strip_common( p1, len1, p2, len2 );
+    if ( len1 == 0 || len2 == 0 ){
+      // the length difference is already checked
+      return max( len1, len2 );
+    }
+    // cell (i,j) of the band is stored at index j-i+k
+    // for the usual small k, we avoid heap allocations
+    const int band = 2*k + 1;
+    unsigned int local_buf[2*32];
+    vector<unsigned int> heap_buf;
+    unsigned int *prev = local_buf;
+    if ( band > 32 ){
+      heap_buf.resize( 2*band );
+      prev = heap_buf.data();
+    }
+    unsigned int *cur = prev + band;
+    fill( prev, prev + 2*band, too_far );
+    for ( int d=k; d < band && d-(int)k <= len2; ++d ){
+      prev[d] = d - k; // the top row: D[0][j] = j
+    }
+    for ( int i=1; i <= len1; ++i ){
+      unsigned int row_min = too_far;
+      for ( int d=0; d < band; ++d ){
+	const int j = i + d - k;
+	unsigned int val = too_far;
+	if ( j == 0 ){
+	  val = i;
+	}
+	else if ( j > 0 && j <= len2 ){
+	  // diagonal
+	  val = prev[d] + ( p1[i-1] == p2[j-1] ? 0 : 1 );
+	  // from above
+	  if ( d+1 < band && prev[d+1] + 1 < val ){
+	    val = prev[d+1] + 1;
+	  }
+	  // from the left
+	  if ( d > 0 && cur[d-1] + 1 < val ){
+	    val = cur[d-1] + 1;
+	  }
+	}
+	if ( val > too_far ){
+	  val = too_far;
+	}
+	cur[d] = val;
+	if ( val < row_min ){
+	  row_min = val;
+	}
+      }
+      if ( row_min > k ){
+	return too_far;
+      }
+      swap( cur, prev );
+    }
+    return prev[len2 - len1 + k];
+  }
+
   bool fillAlphabet( istream& is,
 		     map<UChar,bitType>& alphabet,
 		     int clip ){
@@ -131,34 +507,96 @@ namespace ticcl {
     return true;
   }
 
-  set<bitType> read_bit_set( istream& is ){
-    set<bitType> result;
+  bool fillAlphabet( istream& is,
+		     alphabet_table& alphabet,
+		     int clip ){
+    map<UChar,bitType> chars;
+    if ( !fillAlphabet( is, chars, clip ) ){
+      return false;
+    }
+    alphabet.fill( chars );
+    return true;
+  }
+
+  string_view trim_view( string_view sv ){
+    const char *ws = " \t\r\n\f\v";
+    size_t b = sv.find_first_not_of( ws );
+    if ( b == string_view::npos ){
+      return string_view();
+    }
+    size_t e = sv.find_last_not_of( ws );
+    return sv.substr( b, e - b + 1 );
+  }
+
+  size_t split_view( string_view line,
+		     char sep,
+		     vector<string_view>& fields ){
+    fields.clear();
+    size_t pos = 0;
+    while ( true ){
+      size_t p = line.find( sep, pos );
+      string_view field = trim_view( line.substr( pos, p == string_view::npos
+						  ? string_view::npos
+						  : p - pos ) );
+      if ( !field.empty() ){
+	fields.push_back( field );
+      }
+      if ( p == string_view::npos ){
+	break;
+      }
+      pos = p + 1;
+    }
+    return fields.size();
+  }
+
+  size_t utf16_length( string_view sv ){
+    size_t len = 0;
+    for ( unsigned char c : sv ){
+      if ( (c & 0xC0) != 0x80 ){
+	// not a continuation byte
+	++len;
+	if ( c >= 0xF0 ){
+	  // 4 byte sequences need a surrogate pair
+	  ++len;
+	}
+      }
+    }
+    return len;
+  }
+
+  static vector<bitType> read_bit_values( istream& is ){
+    vector<bitType> result;
     while ( is ){
       bitType bit;
       is >> bit;
       is.ignore( INT_MAX, '\n' );
-      result.insert( bit );
+      result.push_back( bit );
     }
     return result;
   }
 
-  set<bitType> read_anahash( istream& is,
-			     const int& low,
-			     const int& high,
-			     size_t& skipped,
-			     bool verbose ){
-    set<bitType> result;
-    UnicodeString line;
-    while ( TiCC::getline( is, line ) ){
-      vector<UnicodeString> parts = TiCC::split_at( line, "~" );
-      if ( parts.size() > 1 ){
-	bitType bit = TiCC::stringTo<bitType>( parts[0] );
-	vector<UnicodeString> parts2 = TiCC::split_at( parts[1], "#" );
-	if ( parts2.size() > 0 ){
-	  UnicodeString firstItem = parts2[0];
-	  if ( firstItem.length() >= low &&
-	       firstItem.length() <= high ){
-	    result.insert( bit );
+  set<bitType> read_bit_set( istream& is ){
+    vector<bitType> v = read_bit_values( is );
+    return set<bitType>( v.begin(), v.end() );
+  }
+
+  static vector<bitType> read_anahash_values( istream& is,
+					      const int& low,
+					      const int& high,
+					      size_t& skipped,
+					      bool verbose ){
+    vector<bitType> result;
+    string line;
+    vector<string_view> parts;
+    vector<string_view> parts2;
+    while ( getline( is, line ) ){
+      if ( split_view( line, '~', parts ) > 1 ){
+	bitType bit = view_to<bitType>( parts[0] );
+	if ( split_view( parts[1], '#', parts2 ) > 0 ){
+	  const int len = utf16_length( parts2[0] );
+	  if ( len >= low &&
+	       len <= high ){
+	    result.push_back( bit );
 	  }
 	  else {
 	    if ( verbose ){
@@ -172,11 +610,21 @@ namespace ticcl {
     return result;
   }
 
-  set<bitType> read_confusions( istream& is ){
-    set<bitType> result;
+  set<bitType> read_anahash( istream& is,
+			     const int& low,
+			     const int& high,
+			     size_t& skipped,
+			     bool verbose ){
+    vector<bitType> v = read_anahash_values( is, low, high, skipped, verbose );
+    return set<bitType>( v.begin(), v.end() );
+  }
+
+  static vector<bitType> read_confusion_values( istream& is ){
+    vector<bitType> result;
     size_t count = 0;
-    UnicodeString line;
-    while ( TiCC::getline( is, line ) ){
+    string line;
+    vector<string_view> parts;
+    while ( getline( is, line ) ){
       if ( ++count % 1000 == 0 ){
 	cout << ".";
 	cout.flush();
@@ -184,10 +632,9 @@ namespace ticcl {
 	  cout << endl << count << endl;;
 	}
       }
-      vector<UnicodeString> parts = TiCC::split_at( line, "#" );
-      if ( parts.size() > 0 ){
-	bitType bit = TiCC::stringTo<bitType>( parts[0] );
-	result.insert( bit );
+      if ( split_view( line, '#', parts ) > 0 ){
+	bitType bit = view_to<bitType>( parts[0] );
+	result.push_back( bit );
       }
       else {
 	cerr << "problems with line " << line << endl;
@@ -198,4 +645,539 @@ namespace ticcl {
     return result;
   }
 
+  set<bitType> read_confusions( istream& is ){
+    vector<bitType> v = read_confusion_values( is );
+    return set<bitType>( v.begin(), v.end() );
+  }
+
+  static const char bit_magic[8] = { 'T','I','C','C','L','B','S','1' };
+
+  string toString( bit_kind kind ){
+    switch ( kind ){
+    case bit_kind::ANAHASH:
+      return "anahash";
+    case bit_kind::FOCI:
+      return "foci";
+    case bit_kind::CONFUSIONS:
+      return "confusions";
+    default:
+      return "plain";
+    }
+  }
+
+  bit_array::bit_array():
+    _data(0),
+    _size(0),
+    _map(0),
+    _map_size(0)
+  {
+    memset( &_header, 0, sizeof(_header) );
+  }
+
+  bit_array::bit_array( vector<bitType>&& values ): bit_array() {
+    _vec = std::move( values );
+    sort( _vec.begin(), _vec.end() );
+    _vec.erase( unique( _vec.begin(), _vec.end() ), _vec.end() );
+    _vec.shrink_to_fit();
+    _data = _vec.data();
+    _size = _vec.size();
+    _header.count = _size;
+  }
+
+  bit_array::bit_array( bit_array&& other ) noexcept: bit_array() {
+    *this = std::move( other );
+  }
+
+  bit_array& bit_array::operator=( bit_array&& other ) noexcept {
+    if ( this != &other ){
+      release();
+      const bool own = !other.is_mapped();
+      _vec = std::move( other._vec );
+      _data = own ? _vec.data() : other._data;
+      _size = other._size;
+      _map = other._map;
+      _map_size = other._map_size;
+      _header = other._header;
+      other._data = 0;
+      other._size = 0;
+      other._map = 0;
+      other._map_size = 0;
+    }
+    return *this;
+  }
+
+  bit_array::~bit_array(){
+    release();
+  }
+
+  void bit_array::release(){
+    if ( _map ){
+      munmap( _map, _map_size );
+      _map = 0;
+      _map_size = 0;
+    }
+    _vec.clear();
+    _data = 0;
+    _size = 0;
+  }
+
+  bit_array::const_iterator bit_array::find( bitType val ) const {
+    const_iterator it = lower_bound( begin(), end(), val );
+    if ( it != end() && *it == val ){
+      return it;
+    }
+    return end();
+  }
+
+  bit_array bit_array::map_file( const string& file_name ){
+    int fd = open( file_name.c_str(), O_RDONLY );
+    if ( fd < 0 ){
+      throw runtime_error( "unable to open bit file: " + file_name );
+    }
+    struct stat st;
+    if ( fstat( fd, &st ) != 0
+	 || size_t(st.st_size) < sizeof(bit_file_header) ){
+      close( fd );
+      throw runtime_error( "not a bit file: " + file_name );
+    }
+    void *map = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( map == MAP_FAILED ){
+      throw runtime_error( "unable to mmap bit file: " + file_name );
+    }
+    bit_array result;
+    result._map = map;
+    result._map_size = st.st_size;
+    memcpy( &result._header, map, sizeof(bit_file_header) );
+    const bit_file_header& h = result._header;
+    if ( memcmp( h.magic, bit_magic, sizeof(bit_magic) ) != 0
+	 || sizeof(bit_file_header) + h.count * sizeof(bitType)
+	 != size_t(st.st_size) ){
+      throw runtime_error( "corrupt bit file: " + file_name );
+    }
+    result._data = reinterpret_cast<const bitType*>
+      ( static_cast<const char*>(map) + sizeof(bit_file_header) );
+    result._size = h.count;
+    // we will mostly walk or binary search the whole array
+    madvise( map, st.st_size, MADV_WILLNEED );
+    return result;
+  }
+
+  bool is_bit_file( const string& file_name ){
+    ifstream is( file_name, ios::binary );
+    char magic[sizeof(bit_magic)];
+    if ( !is.read( magic, sizeof(magic) ) ){
+      return false;
+    }
+    return memcmp( magic, bit_magic, sizeof(bit_magic) ) == 0;
+  }
+
+  void write_bit_file( const string& file_name,
+		       const bit_array& values,
+		       bit_kind kind,
+		       int low,
+		       int high,
+		       size_t skipped ){
+    bit_file_header h;
+    memset( &h, 0, sizeof(h) );
+    memcpy( h.magic, bit_magic, sizeof(bit_magic) );
+    h.kind = kind;
+    h.low = low;
+    h.high = high;
+    h.count = values.size();
+    h.skipped = skipped;
+    ofstream os( file_name, ios::binary );
+    if ( !os ){
+      throw runtime_error( "unable to write bit file: " + file_name );
+    }
+    os.write( reinterpret_cast<const char*>(&h), sizeof(h) );
+    os.write( reinterpret_cast<const char*>(values.begin()),
+	      values.size() * sizeof(bitType) );
+    if ( !os ){
+      throw runtime_error( "problem writing bit file: " + file_name );
+    }
+  }
+
+  static bit_array map_kind( const string& file_name, bit_kind kind ){
+    bit_array result = bit_array::map_file( file_name );
+    if ( result.header().kind != kind ){
+      throw runtime_error( "bit file " + file_name + " contains "
+			   + toString( result.header().kind )
+			   + " values, not " + toString( kind ) );
+    }
+    return result;
+  }
+
+  bit_array load_bit_set( const string& file_name ){
+    if ( is_bit_file( file_name ) ){
+      return map_kind( file_name, bit_kind::FOCI );
+    }
+    ifstream is( file_name );
+    if ( !is ){
+      throw runtime_error( "unable to open: " + file_name );
+    }
+    return bit_array( read_bit_values( is ) );
+  }
+
+  bit_array load_anahash( const string& file_name,
+			  int low,
+			  int high,
+			  size_t& skipped,
+			  bool verbose ){
+    if ( is_bit_file( file_name ) ){
+      bit_array result = map_kind( file_name, bit_kind::ANAHASH );
+      const bit_file_header& h = result.header();
+      if ( h.low != low || h.high != high ){
+	throw runtime_error( "bit file " + file_name + " was created with"
+			     + " --low=" + TiCC::toString( h.low )
+			     + " --high=" + TiCC::toString( h.high )
+			     + ", not with --low=" + TiCC::toString( low )
+			     + " --high=" + TiCC::toString( high ) );
+      }
+      skipped += h.skipped;
+      return result;
+    }
+    if ( is_anagram_index( file_name ) ){
+      // filter on the first word of every value, like the text file
+      anagram_index index( file_name );
+      vector<bitType> values;
+      values.reserve( index.size() );
+      for ( size_t i=0; i < index.size(); ++i ){
+	if ( index.first_word( i ) == index.first_word( i+1 ) ){
+	  continue;
+	}
+	string_view word = index.word( index.first_word( i ) );
+	const int len = utf16_length( word );
+	if ( len >= low &&
+	     len <= high ){
+	  values.push_back( index.key( i ) );
+	}
+	else {
+	  if ( verbose ){
+	    cerr << "skip " << word << endl;
+	  }
+	  ++skipped;
+	}
+      }
+      return bit_array( std::move( values ) );
+    }
+    ifstream is( file_name );
+    if ( !is ){
+      throw runtime_error( "unable to open: " + file_name );
+    }
+    return bit_array( read_anahash_values( is, low, high, skipped, verbose ) );
+  }
+
+  bit_array load_confusions( const string& file_name ){
+    if ( is_bit_file( file_name ) ){
+      return map_kind( file_name, bit_kind::CONFUSIONS );
+    }
+    ifstream is( file_name );
+    if ( !is ){
+      throw runtime_error( "unable to open: " + file_name );
+    }
+    return bit_array( read_confusion_values( is ) );
+  }
+
+  bool parse_shard( const string& value, size_t& shard, size_t& shards ){
+    string::size_type pos = value.find( '/' );
+    if ( pos == string::npos ){
+      return false;
+    }
+    try {
+      shard = view_to<size_t>( string_view( value ).substr( 0, pos ) );
+      shards = view_to<size_t>( string_view( value ).substr( pos+1 ) );
+    }
+    catch ( const exception& ){
+      return false;
+    }
+    return shard >= 1 && shard <= shards;
+  }
+
+  bit_array shard_of( const bit_array& values, size_t shard, size_t shards ){
+    const size_t first = values.size() * ( shard - 1 ) / shards;
+    const size_t last = values.size() * shard / shards;
+    return bit_array( vector<bitType>( values.begin() + first,
+				       values.begin() + last ) );
+  }
+
+  void bit_hash_set::rehash( size_t buckets ){
+    // buckets MUST be a power of 2
+    vector<bitType> old;
+    old.swap( _table );
+    _table.assign( buckets, EMPTY );
+    _mask = buckets - 1;
+    _shift = 64;
+    while ( buckets > 1 ){
+      --_shift;
+      buckets >>= 1;
+    }
+    for ( const auto& val : old ){
+      if ( val != EMPTY ){
+	size_t pos = slot( val );
+	while ( _table[pos] != EMPTY ){
+	  pos = (pos+1) & _mask;
+	}
+	_table[pos] = val;
+      }
+    }
+  }
+
+  void bit_hash_set::reserve( size_t n ){
+    // keep the load factor below 0.5
+    size_t buckets = 16;
+    while ( buckets < 2*n ){
+      buckets <<= 1;
+    }
+    if ( buckets > _table.size() ){
+      rehash( buckets );
+    }
+  }
+
+  bool bit_hash_set::insert( bitType val ){
+    if ( val == EMPTY ){
+      if ( _has_empty ){
+	return false;
+      }
+      _has_empty = true;
+      ++_size;
+      return true;
+    }
+    if ( 2*(_size+1) > _table.size() ){
+      reserve( _size+1 );
+    }
+    size_t pos = slot( val );
+    while ( _table[pos] != EMPTY ){
+      if ( _table[pos] == val ){
+	return false;
+      }
+      pos = (pos+1) & _mask;
+    }
+    _table[pos] = val;
+    ++_size;
+    return true;
+  }
+
+  uint32_t hash_uchars( const UChar *s, int32_t len ){
+    // FNV-1a on the UTF-16 code units
+    uint32_t h = 2166136261u;
+    for ( int32_t i=0; i < len; ++i ){
+      h ^= s[i];
+      h *= 16777619u;
+    }
+    return h;
+  }
+
+  void word_table::rehash( size_t buckets ){
+    // buckets MUST be a power of 2
+    _slots.assign( buckets, NO_WORD );
+    _mask = buckets - 1;
+    for ( word_id id=0; id < _entries.size(); ++id ){
+      size_t pos = _entries[id].hash & _mask;
+      while ( _slots[pos] != NO_WORD ){
+	pos = (pos+1) & _mask;
+      }
+      _slots[pos] = id;
+    }
+  }
+
+  void word_table::reserve( size_t n ){
+    // room for n words AND their lowercase forms, at a load factor below 0.5
+    _entries.reserve( n );
+    size_t buckets = 16;
+    while ( buckets < 4*n ){
+      buckets <<= 1;
+    }
+    if ( buckets > _slots.size() ){
+      rehash( buckets );
+    }
+  }
+
+  word_id word_table::lookup( const UChar *s,
+			      int32_t len,
+			      uint32_t h ) const {
+    if ( _slots.empty() ){
+      return NO_WORD;
+    }
+    size_t pos = h & _mask;
+    while ( _slots[pos] != NO_WORD ){
+      const entry& e = _entries[_slots[pos]];
+      if ( e.hash == h
+	   && e.length == len
+	   && memcmp( &_pool[e.offset], s, len*sizeof(UChar) ) == 0 ){
+	return _slots[pos];
+      }
+      pos = (pos+1) & _mask;
+    }
+    return NO_WORD;
+  }
+
+  word_id word_table::intern( const UnicodeString& word ){
+    const UChar *s = word.getBuffer();
+    int32_t len = word.length();
+    uint32_t h = hash_uchars( s, len );
+    word_id id = lookup( s, len, h );
+    if ( id != NO_WORD ){
+      return id;
+    }
+    if ( _entries.size() >= NO_WORD - 1 ){
+      throw runtime_error( "word_table: too many words" );
+    }
+    if ( 2*(_entries.size()+1) > _slots.size() ){
+      size_t buckets = ( _slots.empty() ? 16 : 2*_slots.size() );
+      rehash( buckets );
+    }
+    id = _entries.size();
+    entry e;
+    e.offset = _pool.size();
+    e.length = len;
+    e.lower = id;
+    e.freq = 0;
+    e.low_freq = 0;
+    e.hash = h;
+    e.is_word = false;
+    _pool.insert( _pool.end(), s, s+len );
+    _entries.push_back( e );
+    size_t pos = h & _mask;
+    while ( _slots[pos] != NO_WORD ){
+      pos = (pos+1) & _mask;
+    }
+    _slots[pos] = id;
+    return id;
+  }
+
+  word_id word_table::add( const UnicodeString& word, size_t freq ){
+    /// add word with frequency freq, or update the frequency of a known word
+    word_id id = intern( word );
+    if ( !_entries[id].is_word ){
+      _entries[id].is_word = true;
+      ++_words;
+    }
+    _entries[id].freq = freq;
+    UnicodeString low = word;
+    low.toLower();
+    if ( low != word ){
+      word_id low_id = intern( low );
+      _entries[id].lower = low_id;
+    }
+    return id;
+  }
+
+  word_id word_table::add_part( const UnicodeString& part ){
+    word_id id = intern( part );
+    if ( !_entries[id].is_word ){
+      UnicodeString low = part;
+      low.toLower();
+      if ( low != part ){
+	word_id low_id = intern( low );
+	_entries[id].lower = low_id;
+      }
+    }
+    return id;
+  }
+
+  void word_table::split_words( const UnicodeString& separator ){
+    // the parts are interned while we go, so only split the entries that
+    // are there at the start
+    const size_t size = _entries.size();
+    _part_index.clear();
+    _parts.clear();
+    _part_index.reserve( size + 1 );
+    _part_index.push_back( 0 );
+    for ( word_id id=0; id < size; ++id ){
+      if ( _entries[id].is_word ){
+	vector<UnicodeString> parts = TiCC::split_at( word( id ), separator );
+	for ( const auto& p : parts ){
+	  _parts.push_back( add_part( p ) );
+	}
+      }
+      if ( _parts.size() >= NO_WORD ){
+	throw runtime_error( "word_table: too many n-gram parts" );
+      }
+      _part_index.push_back( _parts.size() );
+    }
+  }
+
+  word_id word_table::find( const UnicodeString& word ) const {
+    const UChar *s = word.getBuffer();
+    int32_t len = word.length();
+    word_id id = lookup( s, len, hash_uchars( s, len ) );
+    if ( id != NO_WORD && !_entries[id].is_word ){
+      return NO_WORD;
+    }
+    return id;
+  }
+
+  word_id word_table::find_lower( const UnicodeString& low ) const {
+    const UChar *s = low.getBuffer();
+    int32_t len = low.length();
+    word_id id = lookup( s, len, hash_uchars( s, len ) );
+    if ( id != NO_WORD && _entries[id].lower != id ){
+      return NO_WORD;
+    }
+    return id;
+  }
+
+  const UChar *string_arena::store( const UChar *s, int32_t len ){
+    UChar *result;
+    if ( (size_t)len > _max_block/4 ){
+      // a very long string gets a block of its own
+      _large.emplace_back( new UChar[len] );
+      result = _large.back().get();
+    }
+    else {
+      if ( _blocks.empty() || _pos + len > _block_size ){
+	// start small, and grow with the amount stored
+	_block_size = min( _max_block, max<size_t>( { 4096, _used, size_t(len) } ) );
+	_blocks.emplace_back( new UChar[_block_size] );
+	_pos = 0;
+      }
+      result = _blocks.back().get() + _pos;
+      _pos += len;
+    }
+    copy( s, s+len, result );
+    _used += len;
+    return result;
+  }
+
+  thread_load::thread_load( int threads ):
+    _slots( threads < 1 ? 1 : threads ),
+    _start( now() )
+  {
+    for ( auto& s : _slots ){
+      s.busy = 0;
+      s.items = 0;
+    }
+  }
+
+  void thread_load::add( double seconds, size_t items ){
+    size_t thread = 0;
+#ifdef HAVE_OPENMP
+    thread = omp_get_thread_num();
+#endif
+    if ( thread < _slots.size() ){
+      _slots[thread].busy += seconds;
+      _slots[thread].items += items;
+    }
+  }
+
+  void thread_load::report( ostream& os ) const {
+    double wall = now() - _start;
+    double min_busy = _slots[0].busy;
+    double max_busy = _slots[0].busy;
+    for ( size_t i=0; i < _slots.size(); ++i ){
+      const slot& s = _slots[i];
+      double idle = max( 0.0, wall - s.busy );
+      os << "thread " << i << ": busy " << s.busy << "s, idle " << idle
+	 << "s (" << ( wall > 0 ? 100 * s.busy / wall : 100 ) << "% busy), "
+	 << s.items << " items" << endl;
+      min_busy = min( min_busy, s.busy );
+      max_busy = max( max_busy, s.busy );
+    }
+    if ( _slots.size() > 1 && max_busy > 0 ){
+      os << "load balance (least/most busy thread): "
+	 << 100 * min_busy / max_busy << "%" << endl;
+    }
+  }
+
 } // namespace ticcl
@@ -0,0 +1,296 @@
+/*
+  Copyright (c) 2006 - 2024
+  CLST  - Radboud University
+  ILK   - Tilburg University
+
+  This file is part of ticcltools
+
+  ticcltools is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  ticcltools is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/ticcltools/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+*/
+
+
+// scanning windows of anagram values for confusion differences, as done
+// by TICCL-indexerNT. The AVX2 version is selected at runtime, with a scalar
+// fallback for other CPU's
+
+#include "ticcl/ticcl_common.h"
+
+#include <algorithm>
+#include <iterator>
+#include <climits>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <stdexcept>
+#include <iostream>
+
+#include "config.h"
+#ifdef HAVE_OPENMP
+#include "omp.h"
+#endif
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define TICCL_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace ticcl {
+
+  confusion_filter::confusion_filter( const bitType *b, const bitType *e ):
+    _table( b, e ),
+    _max(0)
+  {
+    // use a power of 2 of at least 32 bits per value, between 2^12 and 2^32
+    int bits = 12;
+    while ( bits < 32 && ( size_t(1) << bits ) < 32 * _table.size() ){
+      ++bits;
+    }
+    _shift = 64 - bits;
+    _bitmap.assign( ( size_t(1) << bits ) / 64, 0 );
+    for ( ; b != e; ++b ){
+      size_t pos = bit_pos( *b );
+      _bitmap[pos >> 6] |= uint64_t(1) << ( pos & 63 );
+      _max = std::max( _max, *b );
+    }
+  }
+
+  void confusion_filter::scan_scalar( bitType focus,
+				      const bitType *vals,
+				      size_t start,
+				      size_t n,
+				      bool below,
+				      vector<size_t>& hits ) const {
+    for ( size_t i=start; i < n; ++i ){
+      bitType diff = below ? focus - vals[i] : vals[i] - focus;
+      if ( contains( diff ) ){
+	hits.push_back( i );
+      }
+    }
+  }
+
+#ifdef TICCL_X86_SIMD
+
+  __attribute__((target("avx2")))
+  void confusion_filter::scan_avx2( bitType focus,
+				    const bitType *vals,
+				    size_t n,
+				    bool below,
+				    vector<size_t>& hits ) const {
+    const __m256i f = _mm256_set1_epi64x( (long long)focus );
+    const __m256i golden = _mm256_set1_epi64x( 0x9E3779B1LL );
+    const __m256i low6 = _mm256_set1_epi64x( 63 );
+    const __m256i one = _mm256_set1_epi64x( 1 );
+    const __m128i shift = _mm_cvtsi32_si128( _shift );
+    const long long *words = (const long long *)_bitmap.data();
+    size_t i = 0;
+    for ( ; i + 4 <= n; i += 4 ){
+      const __m256i v = _mm256_loadu_si256( (const __m256i*)(vals+i) );
+      const __m256i diff = below ? _mm256_sub_epi64( f, v )
+	: _mm256_sub_epi64( v, f );
+      // the same as bit_pos(), _mm256_mul_epu32 uses the low 32 bits
+      const __m256i folded = _mm256_xor_si256( diff,
+					       _mm256_srli_epi64( diff, 32 ) );
+      const __m256i pos = _mm256_srl_epi64( _mm256_mul_epu32( folded, golden ),
+					    shift );
+      const __m256i word = _mm256_i64gather_epi64( words,
+						   _mm256_srli_epi64( pos, 6 ),
+						   8 );
+      const __m256i bit = _mm256_and_si256( _mm256_srlv_epi64( word, _mm256_and_si256( pos, low6 ) ),
+					    one );
+      int mask = _mm256_movemask_pd( _mm256_castsi256_pd( _mm256_slli_epi64( bit, 63 ) ) );
+      // only the few lanes that pass the bitmap go to the hash table
+      while ( mask ){
+	const int l = __builtin_ctz( mask );
+	mask &= mask - 1;
+	const bitType d = below ? focus - vals[i+l] : vals[i+l] - focus;
+	if ( _table.contains( d ) ){
+	  hits.push_back( i+l );
+	}
+      }
+    }
+    scan_scalar( focus, vals, i, n, below, hits );
+  }
+
+#else
+
+  void confusion_filter::scan_avx2( bitType focus,
+				    const bitType *vals,
+				    size_t n,
+				    bool below,
+				    vector<size_t>& hits ) const {
+    scan_scalar( focus, vals, 0, n, below, hits );
+  }
+
+#endif // TICCL_X86_SIMD
+
+  void confusion_filter::scan( bitType focus,
+			       const bitType *vals,
+			       size_t n,
+			       bool below,
+			       vector<size_t>& hits,
+			       ld_kernel kernel ) const {
+    if ( kernel == ld_kernel::AUTO ){
+      kernel = ld_best_kernel();
+    }
+    if ( kernel == ld_kernel::AVX2 ){
+      scan_avx2( focus, vals, n, below, hits );
+    }
+    else {
+      scan_scalar( focus, vals, 0, n, below, hits );
+    }
+  }
+
+  vector<diff_pair> read_index( istream& is ){
+    vector<diff_pair> result;
+    string line;
+    vector<string_view> parts;
+    vector<string_view> values;
+    size_t line_nr = 0;
+    while ( getline( is, line ) ){
+      ++line_nr;
+      const string_view trimmed = trim_view( line );
+      if ( trimmed.empty() ){
+	continue;
+      }
+      if ( split_view( trimmed, '#', parts ) != 2
+	   || split_view( parts[1], ',', values ) < 1 ){
+	throw runtime_error( "invalid index line " + to_string( line_nr )
+			     + ": " + string( trimmed ) );
+      }
+      const bitType confusion = view_to<bitType>( parts[0] );
+      for ( const auto& value : values ){
+	result.emplace_back( confusion, view_to<bitType>( value ) );
+      }
+    }
+    // older indexers wrote the lines in thread order
+    sort( result.begin(), result.end() );
+    result.erase( unique( result.begin(), result.end() ), result.end() );
+    return result;
+  }
+
+  static void append_value( string& buf, bitType val ){
+    char digits[24];
+    auto res = to_chars( digits, digits + sizeof(digits), val );
+    buf.append( digits, res.ptr );
+  }
+
+  void write_index( ostream& os,
+		    const vector<diff_pair>& pairs,
+		    ostream *csf ){
+    string buf;
+    string stats;
+    size_t i = 0;
+    while ( i < pairs.size() ){
+      const bitType confusion = pairs[i].first;
+      const size_t start = i;
+      append_value( buf, confusion );
+      buf += '#';
+      for ( ; i < pairs.size() && pairs[i].first == confusion; ++i ){
+	if ( i > start ){
+	  buf += ',';
+	}
+	append_value( buf, pairs[i].second );
+      }
+      buf += '\n';
+      if ( csf ){
+	append_value( stats, confusion );
+	stats += '#';
+	append_value( stats, i - start );
+	stats += '\n';
+      }
+      if ( buf.size() > 1000000 ){
+	os << buf;
+	buf.clear();
+	if ( csf ){
+	  *csf << stats;
+	  stats.clear();
+	}
+      }
+    }
+    os << buf;
+    if ( csf ){
+      *csf << stats;
+    }
+  }
+
+  size_t confusion_filter::find_pairs( bitType focus,
+				       const bit_array& anagrams,
+				       vector<diff_pair>& pairs ) const {
+    // the anagram values within _max below and above 'focus' are located
+    // with binary searches and then scanned in one go
+    const bitType *pos = anagrams.find( focus );
+    if ( pos == anagrams.end() ){
+      return 0;
+    }
+    const bitType *first = anagrams.begin();
+    if ( focus > _max ){
+      first = lower_bound( anagrams.begin(), pos, focus - _max );
+    }
+    const bitType *last = anagrams.end();
+    if ( focus <= ULLONG_MAX - _max ){
+      last = upper_bound( pos + 1, anagrams.end(), focus + _max );
+    }
+    static thread_local vector<size_t> hits;
+    hits.clear();
+    scan( focus, first, pos - first, true, hits );
+    for ( const auto& i : hits ){
+      pairs.emplace_back( focus - first[i], first[i] );
+    }
+    hits.clear();
+    scan( focus, pos + 1, last - pos - 1, false, hits );
+    for ( const auto& i : hits ){
+      pairs.emplace_back( pos[i+1] - focus, focus );
+    }
+    return last - first - 1;
+  }
+
+  vector<diff_pair> merge_pairs( vector<vector<diff_pair>>& parts ){
+    // sort and unique every part, then merge them pairwise, all in parallel
+    const long n = parts.size();
+#pragma omp parallel for schedule(dynamic)
+    for ( long i=0; i < n; ++i ){
+      sort( parts[i].begin(), parts[i].end() );
+      parts[i].erase( unique( parts[i].begin(), parts[i].end() ),
+		      parts[i].end() );
+    }
+    for ( long step=1; step < n; step *= 2 ){
+#pragma omp parallel for schedule(dynamic)
+      for ( long i=0; i < n - step; i += 2*step ){
+	vector<diff_pair>& left = parts[i];
+	vector<diff_pair>& right = parts[i+step];
+	vector<diff_pair> merged;
+	merged.reserve( left.size() + right.size() );
+	set_union( left.begin(), left.end(),
+		   right.begin(), right.end(),
+		   back_inserter( merged ) );
+	vector<diff_pair>().swap( right );
+	left.swap( merged );
+      }
+    }
+    vector<diff_pair> result;
+    if ( n > 0 ){
+      result.swap( parts[0] );
+    }
+    return result;
+  }
+
+} // namespace ticcl
@@ -0,0 +1,353 @@
+/*
+  Copyright (c) 2006 - 2024
+  CLST  - Radboud University
+  ILK   - Tilburg University
+
+  This file is part of ticcltools
+
+  ticcltools is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  ticcltools is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/ticcltools/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+*/
+
+
+// the binary index format: per confusion value a posting list of anagram
+// values, delta and varint encoded, with a table at the end to find them.
+// (see index_file_header)
+
+#include "ticcl/ticcl_common.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace ticcl {
+
+  static const char index_magic[8] = { 'T','I','C','C','L','I','X','1' };
+
+  static void append_varint( string& buf, uint64_t val ){
+    while ( val >= 0x80 ){
+      buf += char( ( val & 0x7F ) | 0x80 );
+      val >>= 7;
+    }
+    buf += char( val );
+  }
+
+  static uint64_t read_varint( istream& is ){
+    uint64_t result = 0;
+    for ( int shift=0; shift < 64; shift += 7 ){
+      const int c = is.get();
+      if ( c == EOF ){
+	throw runtime_error( "truncated index record" );
+      }
+      result |= uint64_t( c & 0x7F ) << shift;
+      if ( ( c & 0x80 ) == 0 ){
+	return result;
+      }
+    }
+    throw runtime_error( "invalid varint in index record" );
+  }
+
+  index_writer::index_writer( const string& file_name, size_t resume_size ):
+    _name( file_name ),
+    _last( 0 ),
+    _values( 0 ),
+    _pos( sizeof(index_file_header) )
+  {
+    if ( resume_size > 0 ){
+      // rebuild the table from the records before resume_size
+      ifstream is( file_name, ios::binary );
+      index_file_header h;
+      if ( !is.read( reinterpret_cast<char*>(&h), sizeof(h) )
+	   || memcmp( h.magic, index_magic, sizeof(index_magic) ) != 0
+	   || h.table != 0 ){
+	throw runtime_error( "not an unfinished index file: " + file_name );
+      }
+      while ( _pos < resume_size ){
+	_table.push_back( _pos );
+	_last = read_varint( is );
+	_values += read_varint( is );
+	const uint64_t size = read_varint( is );
+	_pos = uint64_t( is.tellg() ) + size;
+	if ( _pos > resume_size || !is.seekg( size, ios::cur ) ){
+	  throw runtime_error( "index file " + file_name
+			       + " doesn't match its checkpoint" );
+	}
+      }
+      is.close();
+      filesystem::resize_file( file_name, resume_size );
+      _os.reset( new fstream( file_name,
+			      ios::in | ios::out | ios::binary ) );
+      _os->seekp( resume_size );
+    }
+    else {
+      _os.reset( new fstream( file_name,
+			      ios::out | ios::binary | ios::trunc ) );
+      index_file_header h;
+      memset( &h, 0, sizeof(h) );
+      memcpy( h.magic, index_magic, sizeof(index_magic) );
+      _os->write( reinterpret_cast<const char*>(&h), sizeof(h) );
+    }
+    if ( !*_os ){
+      throw runtime_error( "unable to write index file: " + file_name );
+    }
+  }
+
+  index_writer::~index_writer(){
+    // without a close() the file stays unfinished
+  }
+
+  void index_writer::encode( const vector<bitType>& values, string& buf ){
+    bitType prev = 0;
+    for ( const auto& val : values ){
+      append_varint( buf, val - prev );
+      prev = val;
+    }
+  }
+
+  void index_writer::add_encoded( bitType confusion,
+				  size_t count,
+				  const char *data,
+				  size_t size ){
+    if ( !_table.empty() && confusion <= _last ){
+      throw runtime_error( "index file " + _name
+			   + ": confusion values out of order" );
+    }
+    string head;
+    append_varint( head, confusion );
+    append_varint( head, count );
+    append_varint( head, size );
+    _os->write( head.data(), head.size() );
+    _os->write( data, size );
+    _table.push_back( _pos );
+    _last = confusion;
+    _pos += head.size() + size;
+    _values += count;
+  }
+
+  void index_writer::add( bitType confusion, const vector<bitType>& values ){
+    static thread_local string buf;
+    buf.clear();
+    encode( values, buf );
+    add_encoded( confusion, values.size(), buf.data(), buf.size() );
+  }
+
+  size_t index_writer::flush(){
+    _os->flush();
+    if ( !*_os ){
+      throw runtime_error( "problem writing index file: " + _name );
+    }
+    return _pos;
+  }
+
+  void index_writer::close(){
+    const size_t pad = ( 8 - _pos % 8 ) % 8;
+    const char zeros[8] = { 0 };
+    _os->write( zeros, pad );
+    index_file_header h;
+    memset( &h, 0, sizeof(h) );
+    memcpy( h.magic, index_magic, sizeof(index_magic) );
+    h.confusions = _table.size();
+    h.values = _values;
+    h.table = _pos + pad;
+    _os->write( reinterpret_cast<const char*>(_table.data()),
+		_table.size() * sizeof(uint64_t) );
+    _os->seekp( 0 );
+    _os->write( reinterpret_cast<const char*>(&h), sizeof(h) );
+    _os->close();
+    if ( !*_os ){
+      throw runtime_error( "problem writing index file: " + _name );
+    }
+  }
+
+  index_reader::index_reader( const string& file_name ):
+    _data(0),
+    _table(0),
+    _map(0),
+    _map_size(0)
+  {
+    int fd = open( file_name.c_str(), O_RDONLY );
+    if ( fd < 0 ){
+      throw runtime_error( "unable to open index file: " + file_name );
+    }
+    struct stat st;
+    if ( fstat( fd, &st ) != 0
+	 || size_t(st.st_size) < sizeof(index_file_header) ){
+      close( fd );
+      throw runtime_error( "not an index file: " + file_name );
+    }
+    _map = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( _map == MAP_FAILED ){
+      _map = 0;
+      throw runtime_error( "unable to mmap index file: " + file_name );
+    }
+    _map_size = st.st_size;
+    memcpy( &_header, _map, sizeof(index_file_header) );
+    if ( memcmp( _header.magic, index_magic, sizeof(index_magic) ) != 0 ){
+      munmap( _map, _map_size );
+      throw runtime_error( "not an index file: " + file_name );
+    }
+    if ( _header.table == 0
+	 || _header.table % 8 != 0
+	 || _header.table + _header.confusions * sizeof(uint64_t)
+	 != _map_size ){
+      munmap( _map, _map_size );
+      throw runtime_error( "unfinished or corrupt index file: " + file_name );
+    }
+    _data = static_cast<const unsigned char*>(_map);
+    _table = reinterpret_cast<const uint64_t*>( _data + _header.table );
+    // the posting lists are mostly read from front to back
+    madvise( _map, _map_size, MADV_SEQUENTIAL );
+  }
+
+  index_reader::~index_reader(){
+    if ( _map ){
+      munmap( _map, _map_size );
+    }
+  }
+
+  static const unsigned char *decode_varint( const unsigned char *p,
+					     const unsigned char *end,
+					     uint64_t& val ){
+    // returns 0 when the varint runs past end
+    val = 0;
+    for ( int shift=0; p < end && shift < 64; shift += 7 ){
+      val |= uint64_t( *p & 0x7F ) << shift;
+      if ( ( *p++ & 0x80 ) == 0 ){
+	return p;
+      }
+    }
+    return 0;
+  }
+
+  const unsigned char *index_reader::record( size_t i,
+					     bitType& confusion,
+					     uint64_t& count,
+					     uint64_t& size ) const {
+    // decode the start of the i-th record, returns the start of its values
+    const unsigned char *end = _data + _header.table;
+    const unsigned char *p = _data + _table[i];
+    if ( _table[i] < sizeof(index_file_header)
+	 || _table[i] >= _header.table
+	 || !( p = decode_varint( p, end, confusion ) )
+	 || !( p = decode_varint( p, end, count ) )
+	 || !( p = decode_varint( p, end, size ) )
+	 || size > size_t( end - p ) ){
+      throw runtime_error( "corrupt index record " + to_string( i ) );
+    }
+    return p;
+  }
+
+  bitType index_reader::confusion( size_t i ) const {
+    bitType confusion;
+    uint64_t count, size;
+    record( i, confusion, count, size );
+    return confusion;
+  }
+
+  bitType index_reader::values( size_t i, vector<bitType>& result ) const {
+    bitType confusion;
+    uint64_t count, size;
+    const unsigned char *p = record( i, confusion, count, size );
+    const unsigned char *end = p + size;
+    result.clear();
+    result.reserve( count );
+    bitType prev = 0;
+    while ( p < end ){
+      uint64_t delta;
+      p = decode_varint( p, end, delta );
+      if ( !p ){
+	break;
+      }
+      prev += delta;
+      result.push_back( prev );
+    }
+    if ( result.size() != count ){
+      throw runtime_error( "corrupt index record for confusion "
+			   + to_string( confusion ) );
+    }
+    return confusion;
+  }
+
+  bool is_index_file( const string& file_name ){
+    ifstream is( file_name, ios::binary );
+    char magic[sizeof(index_magic)];
+    if ( !is.read( magic, sizeof(magic) ) ){
+      return false;
+    }
+    return memcmp( magic, index_magic, sizeof(index_magic) ) == 0;
+  }
+
+  vector<diff_pair> load_index( const string& file_name ){
+    if ( !is_index_file( file_name ) ){
+      ifstream is( file_name );
+      if ( !is ){
+	throw runtime_error( "unable to open: " + file_name );
+      }
+      return read_index( is );
+    }
+    index_reader index( file_name );
+    vector<diff_pair> result;
+    result.reserve( index.value_count() );
+    vector<bitType> values;
+    for ( size_t i=0; i < index.size(); ++i ){
+      const bitType confusion = index.values( i, values );
+      for ( const auto& val : values ){
+	result.emplace_back( confusion, val );
+      }
+    }
+    return result;
+  }
+
+  void write_index( index_writer& iw,
+		    const vector<diff_pair>& pairs,
+		    ostream *csf ){
+    vector<bitType> values;
+    string stats;
+    size_t i = 0;
+    while ( i < pairs.size() ){
+      const bitType confusion = pairs[i].first;
+      values.clear();
+      for ( ; i < pairs.size() && pairs[i].first == confusion; ++i ){
+	values.push_back( pairs[i].second );
+      }
+      iw.add( confusion, values );
+      if ( csf ){
+	stats += to_string( confusion ) + "#"
+	  + to_string( values.size() ) + "\n";
+	if ( stats.size() > 1000000 ){
+	  *csf << stats;
+	  stats.clear();
+	}
+      }
+    }
+    if ( csf ){
+      *csf << stats;
+    }
+  }
+
+} // namespace ticcl
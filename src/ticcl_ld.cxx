@@ -0,0 +1,304 @@
+/*
+  Copyright (c) 2006 - 2024
+  CLST  - Radboud University
+  ILK   - Tilburg University
+
+  This file is part of ticcltools
+
+  ticcltools is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  ticcltools is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/ticcltools/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+*/
+
+// one query versus many candidates Levenshtein distances.
+// the Myers/Hyyrö bit-vector algorithm (see ldCompare()) is run for several
+// candidates at once, one candidate per 64 bit SIMD lane.
+// The SSE4.1 and AVX2 versions are selected at runtime, with a scalar
+// fallback for other CPU's
+
+#include "ticcl/ticcl_common.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define TICCL_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+using namespace icu;
+using namespace std;
+
+namespace ticcl {
+
+  struct query_peq {
+    // the pattern bitmasks of the query, like in myers_64()
+    query_peq( const UChar *pat, int m ): high_cnt(0) {
+      fill( low, low+256, 0 );
+      for ( int i=0; i < m; ++i ){
+	const uint64_t bit = uint64_t(1) << i;
+	if ( pat[i] < 256 ){
+	  low[pat[i]] |= bit;
+	}
+	else {
+	  int k = 0;
+	  while ( k < high_cnt && high_char[k] != pat[i] ){
+	    ++k;
+	  }
+	  if ( k == high_cnt ){
+	    high_char[high_cnt] = pat[i];
+	    high_peq[high_cnt++] = 0;
+	  }
+	  high_peq[k] |= bit;
+	}
+      }
+    }
+    uint64_t operator()( UChar c ) const {
+      if ( c < 256 ){
+	return low[c];
+      }
+      for ( int k=0; k < high_cnt; ++k ){
+	if ( high_char[k] == c ){
+	  return high_peq[k];
+	}
+      }
+      return 0;
+    }
+    uint64_t low[256];
+    UChar high_char[64];
+    uint64_t high_peq[64];
+    int high_cnt;
+  };
+
+  static unsigned int many_one( const query_peq& peq, int m,
+				const UChar *txt, int n ){
+    // the scalar kernel, for one candidate
+    uint64_t Pv = ~uint64_t(0);
+    uint64_t Mv = 0;
+    const uint64_t last = uint64_t(1) << (m-1);
+    unsigned int score = m;
+    for ( int j=0; j < n; ++j ){
+      const uint64_t Eq = peq( txt[j] );
+      const uint64_t Xv = Eq | Mv;
+      const uint64_t Xh = (((Eq & Pv) + Pv) ^ Pv) | Eq;
+      uint64_t Ph = Mv | ~(Xh | Pv);
+      uint64_t Mh = Pv & Xh;
+      if ( Ph & last ){
+	++score;
+      }
+      else if ( Mh & last ){
+	--score;
+      }
+      Ph = (Ph << 1) | 1;
+      Mh <<= 1;
+      Pv = Mh | ~(Xv | Ph);
+      Mv = Ph & Xv;
+    }
+    return score;
+  }
+
+  static void many_scalar( const query_peq& peq, int m,
+			   const UnicodeString *cands, size_t n,
+			   unsigned int *result ){
+    for ( size_t i=0; i < n; ++i ){
+      result[i] = many_one( peq, m, cands[i].getBuffer(), cands[i].length() );
+    }
+  }
+
+#ifdef TICCL_X86_SIMD
+
+  template <int LANES>
+  static int fill_lanes( const query_peq& peq,
+			 const UnicodeString *cands,
+			 vector<uint64_t>& eqs,
+			 int64_t *len ){
+    // store the Eq masks of LANES candidates interleaved, padded with 0
+    int max_len = 0;
+    for ( int l=0; l < LANES; ++l ){
+      len[l] = cands[l].length();
+      max_len = max( max_len, int(len[l]) );
+    }
+    eqs.assign( size_t(max_len) * LANES, 0 );
+    for ( int l=0; l < LANES; ++l ){
+      const UChar *txt = cands[l].getBuffer();
+      for ( int j=0; j < len[l]; ++j ){
+	eqs[j*LANES+l] = peq( txt[j] );
+      }
+    }
+    return max_len;
+  }
+
+  __attribute__((target("avx2")))
+  static void many_avx2( const query_peq& peq, int m,
+			 const UnicodeString *cands, size_t n,
+			 unsigned int *result ){
+    const __m256i last = _mm256_set1_epi64x( (long long)(uint64_t(1) << (m-1)) );
+    const __m256i ones = _mm256_set1_epi64x( -1 );
+    const __m256i one = _mm256_set1_epi64x( 1 );
+    static thread_local vector<uint64_t> eqs;
+    size_t i = 0;
+    for ( ; i + 4 <= n; i += 4 ){
+      alignas(32) int64_t len[4];
+      const int max_len = fill_lanes<4>( peq, cands+i, eqs, len );
+      const __m256i lens = _mm256_load_si256( (const __m256i*)len );
+      __m256i Pv = ones;
+      __m256i Mv = _mm256_setzero_si256();
+      __m256i score = _mm256_set1_epi64x( m );
+      for ( int j=0; j < max_len; ++j ){
+	const __m256i Eq = _mm256_loadu_si256( (const __m256i*)&eqs[j*4] );
+	// the lanes that still have characters left
+	const __m256i A = _mm256_cmpgt_epi64( lens, _mm256_set1_epi64x( j ) );
+	const __m256i Xv = _mm256_or_si256( Eq, Mv );
+	const __m256i EqPv = _mm256_and_si256( Eq, Pv );
+	const __m256i Xh = _mm256_or_si256( _mm256_xor_si256( _mm256_add_epi64( EqPv, Pv ), Pv ), Eq );
+	__m256i Ph = _mm256_or_si256( Mv, _mm256_andnot_si256( _mm256_or_si256( Xh, Pv ), ones ) );
+	__m256i Mh = _mm256_and_si256( Pv, Xh );
+	const __m256i p_inc = _mm256_and_si256( _mm256_cmpeq_epi64( _mm256_and_si256( Ph, last ), last ), A );
+	const __m256i m_inc = _mm256_and_si256( _mm256_cmpeq_epi64( _mm256_and_si256( Mh, last ), last ), A );
+	// the compares give -1 for 'true'
+	score = _mm256_add_epi64( _mm256_sub_epi64( score, p_inc ), m_inc );
+	Ph = _mm256_or_si256( _mm256_slli_epi64( Ph, 1 ), one );
+	Mh = _mm256_slli_epi64( Mh, 1 );
+	const __m256i nPv = _mm256_or_si256( Mh, _mm256_andnot_si256( _mm256_or_si256( Xv, Ph ), ones ) );
+	const __m256i nMv = _mm256_and_si256( Ph, Xv );
+	// finished lanes keep their state
+	Pv = _mm256_blendv_epi8( Pv, nPv, A );
+	Mv = _mm256_blendv_epi8( Mv, nMv, A );
+      }
+      alignas(32) int64_t res[4];
+      _mm256_store_si256( (__m256i*)res, score );
+      for ( int l=0; l < 4; ++l ){
+	result[i+l] = res[l];
+      }
+    }
+    many_scalar( peq, m, cands+i, n-i, result+i );
+  }
+
+  __attribute__((target("sse4.1")))
+  static void many_sse4( const query_peq& peq, int m,
+			 const UnicodeString *cands, size_t n,
+			 unsigned int *result ){
+    const __m128i last = _mm_set1_epi64x( (long long)(uint64_t(1) << (m-1)) );
+    const __m128i ones = _mm_set1_epi64x( -1 );
+    const __m128i one = _mm_set1_epi64x( 1 );
+    static thread_local vector<uint64_t> eqs;
+    size_t i = 0;
+    for ( ; i + 2 <= n; i += 2 ){
+      alignas(16) int64_t len[2];
+      const int max_len = fill_lanes<2>( peq, cands+i, eqs, len );
+      __m128i Pv = ones;
+      __m128i Mv = _mm_setzero_si128();
+      __m128i score = _mm_set1_epi64x( m );
+      for ( int j=0; j < max_len; ++j ){
+	const __m128i Eq = _mm_loadu_si128( (const __m128i*)&eqs[j*2] );
+	// _mm_cmpgt_epi64 is SSE4.2, so build the lane mask by hand
+	const __m128i A = _mm_set_epi64x( j < len[1] ? -1 : 0,
+					  j < len[0] ? -1 : 0 );
+	const __m128i Xv = _mm_or_si128( Eq, Mv );
+	const __m128i EqPv = _mm_and_si128( Eq, Pv );
+	const __m128i Xh = _mm_or_si128( _mm_xor_si128( _mm_add_epi64( EqPv, Pv ), Pv ), Eq );
+	__m128i Ph = _mm_or_si128( Mv, _mm_andnot_si128( _mm_or_si128( Xh, Pv ), ones ) );
+	__m128i Mh = _mm_and_si128( Pv, Xh );
+	const __m128i p_inc = _mm_and_si128( _mm_cmpeq_epi64( _mm_and_si128( Ph, last ), last ), A );
+	const __m128i m_inc = _mm_and_si128( _mm_cmpeq_epi64( _mm_and_si128( Mh, last ), last ), A );
+	score = _mm_add_epi64( _mm_sub_epi64( score, p_inc ), m_inc );
+	Ph = _mm_or_si128( _mm_slli_epi64( Ph, 1 ), one );
+	Mh = _mm_slli_epi64( Mh, 1 );
+	const __m128i nPv = _mm_or_si128( Mh, _mm_andnot_si128( _mm_or_si128( Xv, Ph ), ones ) );
+	const __m128i nMv = _mm_and_si128( Ph, Xv );
+	Pv = _mm_blendv_epi8( Pv, nPv, A );
+	Mv = _mm_blendv_epi8( Mv, nMv, A );
+      }
+      alignas(16) int64_t res[2];
+      _mm_store_si128( (__m128i*)res, score );
+      result[i] = res[0];
+      result[i+1] = res[1];
+    }
+    many_scalar( peq, m, cands+i, n-i, result+i );
+  }
+
+#endif // TICCL_X86_SIMD
+
+  static ld_kernel detect_kernel(){
+#ifdef TICCL_X86_SIMD
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) ){
+      return ld_kernel::AVX2;
+    }
+    if ( __builtin_cpu_supports( "sse4.1" ) ){
+      return ld_kernel::SSE4;
+    }
+#endif
+    return ld_kernel::SCALAR;
+  }
+
+  ld_kernel ld_best_kernel(){
+    static const ld_kernel best = detect_kernel();
+    return best;
+  }
+
+  string toString( ld_kernel k ){
+    switch ( k ){
+    case ld_kernel::AVX2:
+      return "avx2";
+    case ld_kernel::SSE4:
+      return "sse4.1";
+    case ld_kernel::SCALAR:
+      return "scalar";
+    default:
+      return "auto";
+    }
+  }
+
+  void ldCompareMany( const UnicodeString& query,
+		      const UnicodeString *cands,
+		      size_t n,
+		      unsigned int *result,
+		      ld_kernel kernel ){
+    const int m = query.length();
+    if ( m == 0 ){
+      for ( size_t i=0; i < n; ++i ){
+	result[i] = cands[i].length();
+      }
+      return;
+    }
+    if ( m > 64 ){
+      // too long for the one word kernels
+      for ( size_t i=0; i < n; ++i ){
+	result[i] = ldCompare( query, cands[i] );
+      }
+      return;
+    }
+    const query_peq peq( query.getBuffer(), m );
+    const ld_kernel best = ld_best_kernel();
+    if ( kernel == ld_kernel::AUTO || kernel > best ){
+      kernel = best;
+    }
+#ifdef TICCL_X86_SIMD
+    if ( kernel == ld_kernel::AVX2 ){
+      many_avx2( peq, m, cands, n, result );
+      return;
+    }
+    if ( kernel == ld_kernel::SSE4 ){
+      many_sse4( peq, m, cands, n, result );
+      return;
+    }
+#endif
+    many_scalar( peq, m, cands, n, result );
+  }
+
+} // namespace ticcl
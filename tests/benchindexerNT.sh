@@ -0,0 +1,64 @@
+#!/bin/bash
+# thread scaling benchmark for TICCL-indexerNT. Uses the anagram, foci and
+# confusion files that testallNT.sh leaves in OUT/<outsub>/TICCL, so run that
+# first. The output must be the same for every number of threads.
+# usage: benchindexerNT.sh [outsub] [bindir]
+
+if [ "$1" != "" ]
+then
+    outsub=$1
+else
+    outsub=zzz
+fi
+
+if [ "$2" != "" ]
+then
+    bindir=$2
+else
+    bindir=../src
+fi
+
+if [ ! -x $bindir/TICCL-indexerNT ]
+then
+    echo "cannot find TICCL-indexerNT in $bindir"
+    exit
+fi
+
+outdir=OUT/$outsub/TICCL
+if [ ! -f $outdir/TESTDP035.clean.anahash ]
+then
+    echo "cannot find $outdir/TESTDP035.clean.anahash (run testallNT.sh first)"
+    exit
+fi
+
+benchdir=$outdir/bench
+mkdir -p $benchdir
+
+base=""
+for threads in 1 2 4 8 16
+do
+    start=$(date +%s.%N)
+    $bindir/TICCL-indexerNT -t $threads --hash $outdir/TESTDP035.clean.anahash --charconf $outdir/aspell.clip20.ld2.charconfus --foci $outdir/TESTDP035.clean.corpusfoci -o $benchdir/bench.t$threads > $benchdir/bench.t$threads.log
+    if [ $? -ne 0 ]
+    then
+	echo "TICCL-indexerNT failed on $threads threads"
+	exit
+    fi
+    end=$(date +%s.%N)
+    secs=$(awk "BEGIN { printf \"%.2f\", $end - $start }")
+    if [ "$base" == "" ]
+    then
+	base=$secs
+    fi
+    echo "$threads threads: $secs s, speedup $(awk "BEGIN { printf \"%.2f\", $base / $secs }")"
+    grep "load balance" $benchdir/bench.t$threads.log
+    cmp -s $benchdir/bench.t1.indexNT $benchdir/bench.t$threads.indexNT
+    if [ $? -ne 0 ]
+    then
+	echo "different output on $threads threads"
+	echo "using: diff $benchdir/bench.t1.indexNT $benchdir/bench.t$threads.indexNT"
+	exit
+    fi
+done
+
+echo "OK"
@@ -0,0 +1,37 @@
+#!/bin/bash
+# benchmark the bit-parallel ticcl::ldCompare against the classic DP
+# version. needs the ticcl_bench program, build it with 'make check'
+
+if [ "$1" != "" ]
+then
+    benchdir=$1
+else
+    benchdir=../src
+fi
+
+if [ ! -x $benchdir/ticcl_bench ]
+then
+    echo "cannot find ticcl_bench in $benchdir (run 'make check' first)"
+    exit
+fi
+
+datadir=DATA
+testdir=TESTDATA
+
+echo "LD benchmark on the clean test words"
+$benchdir/ticcl_bench ld $testdir/clean2 50
+if [ $? -ne 0 ]
+then
+    echo "ldCompare benchmark failed"
+    exit
+fi
+
+echo "LD benchmark on the aspell dictionary"
+$benchdir/ticcl_bench ld $datadir/nld.aspell.dict 20
+if [ $? -ne 0 ]
+then
+    echo "ldCompare benchmark failed"
+    exit
+fi
+
+echo "OK"
@@ -0,0 +1,80 @@
+#!/bin/bash
+# thread scaling benchmark for TICCL-LDcalc on the n-gram data of
+# testngram.sh. Most pairs there are n-grams, so this shows how well the
+# threads keep up while counting them. The output must be the same for
+# every number of threads, also with historical and diacritical
+# confusions.
+# usage: benchngram.sh [bindir]
+
+if [ "$1" != "" ]
+then
+    bindir=$1
+else
+    bindir=../src
+fi
+
+if [ ! -x $bindir/TICCL-LDcalc ]
+then
+    echo "cannot find TICCL-LDcalc in $bindir"
+    exit
+fi
+
+outdir=TESTRESULTS
+datadir=TRI
+
+if [ ! -f $datadir/mre.indexNT ]
+then
+    echo "cannot find the n-gram data in $datadir"
+    exit
+fi
+
+benchdir=$outdir/bench
+mkdir -p $benchdir
+
+# historical and diacritical confusions for every other line of the index,
+# so the transpositions of an anagram value are claimed by lines with
+# different flags, and --nohld keeps them apart
+awk -F'#' 'NR % 2 { print $1 "#a~b" }' $datadir/mre.indexNT > $benchdir/confus.diac
+
+for run in plain hist
+do
+    if [ "$run" == "hist" ]
+    then
+	extra="--hist $benchdir/confus.diac --diac $benchdir/confus.diac --nohld --artifrq 5"
+    else
+	extra="--artifrq 100000000"
+    fi
+    echo "$run:"
+    base=""
+    for threads in 1 2 4 8 16
+    do
+	out=$benchdir/$run.t$threads
+	start=$(date +%s.%N)
+	$bindir/TICCL-LDcalc --index $datadir/mre.indexNT --hash $datadir/mre.anahash --clean $datadir/mre.clean --LD 2 -t $threads $extra --checkpoint=0 -o $out > $out.log
+	if [ $? -ne 0 ]
+	then
+	    echo "TICCL-LDcalc failed on $threads threads"
+	    exit
+	fi
+	end=$(date +%s.%N)
+	secs=$(awk "BEGIN { printf \"%.2f\", $end - $start }")
+	if [ "$base" == "" ]
+	then
+	    base=$secs
+	fi
+	echo "$threads threads: $secs s, speedup $(awk "BEGIN { printf \"%.2f\", $base / $secs }")"
+	for ext in ldcalc short.ldcalc ldcalc.ambi
+	do
+	    LC_ALL=C sort $out.$ext > $out.$ext.sorted
+	    cmp -s $benchdir/$run.t1.$ext.sorted $out.$ext.sorted
+	    if [ $? -ne 0 ]
+	    then
+		echo "different $ext output on $threads threads"
+		echo "using: diff $benchdir/$run.t1.$ext.sorted $out.$ext.sorted"
+		exit
+	    fi
+	done
+    done
+done
+
+echo "OK"